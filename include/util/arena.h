@@ -0,0 +1,245 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <vector>
+
+// One large GL buffer that is handed out in pieces. Free ranges are kept in a list sorted by offset and merged with
+// their neighbors when a piece is freed; allocations take the smallest range that fits (best fit). When nothing fits
+// the buffer grows. Pieces are addressed by handles, so compact() can move them to the front of the buffer.
+//
+// All uploads and copies go through GL_COPY_WRITE_BUFFER/GL_COPY_READ_BUFFER, so the bindings of a vertex array
+// object are never touched. Whenever the buffer object is replaced (grow or compact), getGeneration() changes and
+// vertex arrays that refer to getBuffer() have to be set up again.
+class BufferArena
+{
+public:
+    typedef std::uint32_t Handle;
+    static constexpr Handle INVALID = 0xffffffffu;
+
+    struct Stats
+    {
+        GLsizeiptr capacity = 0;
+        GLsizeiptr used = 0;
+        GLsizeiptr largestFree = 0;
+        size_t allocations = 0;
+        size_t freeRanges = 0;
+
+        // share of the free space that is not part of the largest free range; 0 is perfectly compact
+        float fragmentation() const
+        {
+            GLsizeiptr free = capacity - used;
+            return free > 0 ? 1.0f - (float)largestFree / (float)free : 0.0f;
+        }
+    };
+
+    // all offsets and sizes are multiples of alignment, e.g. the vertex size so offsets can be used as base vertex
+    BufferArena(GLsizeiptr initialCapacity, GLsizeiptr alignment) : alignment(alignment)
+    {
+        create(std::max(roundUp(initialCapacity), alignment));
+        freeRanges[0] = capacity;
+    }
+
+    ~BufferArena() { glDeleteBuffers(1, &buffer); }
+
+    BufferArena(const BufferArena &) = delete;
+    BufferArena &operator=(const BufferArena &) = delete;
+
+    GLuint getBuffer() const { return buffer; }
+    unsigned int getGeneration() const { return generation; }
+    GLsizeiptr getAlignment() const { return alignment; }
+
+    // reserves dataSize bytes (rounded up to the alignment) and uploads data (if not null) into them
+    // ------------------------------------------------------------------------
+    Handle allocate(GLsizeiptr dataSize, const void *data)
+    {
+        GLsizeiptr size = std::max(roundUp(dataSize), alignment);
+        auto range = bestFit(size);
+        if (range == freeRanges.end())
+        {
+            // used + size isn't enough: the free space may be split up, and only the new tail is sure to fit
+            grow(capacity + size);
+            range = bestFit(size);
+        }
+        GLintptr offset = range->first;
+        GLsizeiptr rest = range->second - size;
+        freeRanges.erase(range);
+        if (rest > 0)
+            freeRanges[offset + size] = rest;
+
+        Handle handle;
+        if (!freeHandles.empty())
+        {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+        }
+        else
+        {
+            handle = (Handle)blocks.size();
+            blocks.push_back({});
+        }
+        blocks[handle] = {offset, size, true};
+        used += size;
+
+        if (data && dataSize > 0)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset, dataSize, data);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        return handle;
+    }
+
+    // returns a piece to the arena
+    // ------------------------------------------------------------------------
+    void free(Handle handle)
+    {
+        if (handle >= blocks.size() || !blocks[handle].live)
+            return;
+        Block &block = blocks[handle];
+        block.live = false;
+        used -= block.size;
+        freeHandles.push_back(handle);
+
+        // merge with the free neighbors
+        GLintptr offset = block.offset;
+        GLsizeiptr size = block.size;
+        auto next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && next->first == offset + size)
+        {
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += size;
+                return;
+            }
+        }
+        freeRanges[offset] = size;
+    }
+
+    GLintptr offset(Handle handle) const { return blocks[handle].offset; }
+    GLsizeiptr size(Handle handle) const { return blocks[handle].size; }
+
+    Stats getStats() const
+    {
+        Stats stats;
+        stats.capacity = capacity;
+        stats.used = used;
+        stats.allocations = blocks.size() - freeHandles.size();
+        stats.freeRanges = freeRanges.size();
+        for (const auto &range : freeRanges)
+            stats.largestFree = std::max(stats.largestFree, range.second);
+        return stats;
+    }
+
+    // moves all pieces to the front of a new buffer of the same size, so the free space is one range again
+    // ------------------------------------------------------------------------
+    void compact()
+    {
+        if (freeRanges.size() <= 1 && (freeRanges.empty() || freeRanges.rbegin()->first + freeRanges.rbegin()->second == capacity))
+            return; // already compact
+        std::vector<Handle> order;
+        for (Handle handle = 0; handle < blocks.size(); handle++)
+            if (blocks[handle].live)
+                order.push_back(handle);
+        std::sort(order.begin(), order.end(), [this](Handle a, Handle b)
+                  { return blocks[a].offset < blocks[b].offset; });
+
+        GLuint old = buffer;
+        create(capacity);
+        glBindBuffer(GL_COPY_READ_BUFFER, old);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        GLintptr offset = 0;
+        for (Handle handle : order)
+        {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, blocks[handle].offset, offset, blocks[handle].size);
+            blocks[handle].offset = offset;
+            offset += blocks[handle].size;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &old);
+
+        freeRanges.clear();
+        if (offset < capacity)
+            freeRanges[offset] = capacity - offset;
+    }
+
+private:
+    struct Block
+    {
+        GLintptr offset;
+        GLsizeiptr size;
+        bool live;
+    };
+
+    GLuint buffer = 0;
+    GLsizeiptr capacity = 0;
+    GLsizeiptr used = 0;
+    GLsizeiptr alignment;
+    unsigned int generation = 0;
+    std::vector<Block> blocks;
+    std::vector<Handle> freeHandles;
+    std::map<GLintptr, GLsizeiptr> freeRanges; // offset -> size
+
+    GLsizeiptr roundUp(GLsizeiptr size) const { return (size + alignment - 1) / alignment * alignment; }
+
+    void create(GLsizeiptr newCapacity)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        capacity = newCapacity;
+        generation++;
+    }
+
+    std::map<GLintptr, GLsizeiptr>::iterator bestFit(GLsizeiptr size)
+    {
+        auto best = freeRanges.end();
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+            if (it->second >= size && (best == freeRanges.end() || it->second < best->second))
+                best = it;
+        return best;
+    }
+
+    // at least doubles the capacity, the contents keep their offsets
+    void grow(GLsizeiptr minCapacity)
+    {
+        GLsizeiptr oldCapacity = capacity;
+        GLuint old = buffer;
+        create(roundUp(std::max(minCapacity + minCapacity / 2, 2 * capacity)));
+        glBindBuffer(GL_COPY_READ_BUFFER, old);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCapacity);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &old);
+
+        // the new space joins a free range at the end of the old buffer
+        GLintptr offset = oldCapacity;
+        GLsizeiptr size = capacity - oldCapacity;
+        if (!freeRanges.empty())
+        {
+            auto last = std::prev(freeRanges.end());
+            if (last->first + last->second == oldCapacity)
+            {
+                offset = last->first;
+                size += last->second;
+                freeRanges.erase(last);
+            }
+        }
+        freeRanges[offset] = size;
+    }
+};
+#endif
@@ -6,11 +6,19 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include <set>
 #include <string>
+#include <typeindex>
 #include <vector>
 #include <optional>
 #include <any>
+#include <cassert>
+#include <memory>
 #include <chrono> // for timing
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <future>
 
 #include <util/model.h>
 
@@ -19,43 +27,46 @@ bool powerOf2(int n)
     return (n & (n - 1)) == 0; // see http://www.graphics.stanford.edu/~seander/bithacks.html or https://stackoverflow.com/questions/108318/whats-the-simplest-way-to-test-whether-a-number-is-a-power-of-2-in-c
 }
 
-// utility function for loading a 2D texture from file
+// utility function for loading a 2D texture from file; a baked <path>.ktx (see tex-bake) with the same orientation is
+// uploaded as it is instead, baked tells which one it was
 // ---------------------------------------------------
-unsigned int loadTexture(const char *path)
+unsigned int loadTexture(const char *path, bool flip = false, bool *baked = nullptr)
 {
+    KtxTexture bakedTexture = ReadKtx(std::string(path) + ".ktx");
+    if (bakedTexture.valid() && bakedTexture.flipped == flip)
+    {
+        if (unsigned int bakedID = TextureFromKtx(bakedTexture, GL_MIRRORED_REPEAT))
+        {
+            if (baked)
+                *baked = true;
+            return bakedID;
+        }
+    }
+    if (baked)
+        *baked = false;
+
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-
-    // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
-    // stbi_set_flip_vertically_on_load(flipVertically);
-
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
+    // the texture is treated as color: its mip levels are averaged in linear light
+    DecodedImage image = DecodePixels(path, flip);
+    image.srgb = true;
+    if (image.pixels)
     {
         try
         {
-            if (width <= 0 || height <= 0)
+            if (image.width <= 0 || image.height <= 0)
                 throw "Texture is 0 in at least one dimension!";
-
-            // test for power of 2
-            if (!powerOf2(width) || !powerOf2(height))
-                throw "Texture is not power of 2!"; // if this happens make sure that the texture has power of 2 dimensions (e.g., 512, 1024, ...)
-
-            GLenum format;
-            if (nrComponents == 1)
-                format = GL_RED;
-            else if (nrComponents == 3)
-                format = GL_RGB;
-            else if (nrComponents == 4)
-                format = GL_RGBA;
-            else
+            if (image.channels != 1 && image.channels != 3 && image.channels != 4)
                 throw "Number of Channels not supported!";
 
+            // textures that are not power of 2 are resized to the closest one (e.g., 512, 1024, ...)
+            if (!powerOf2(image.width) || !powerOf2(image.height))
+                std::cout << "(resizing " << image.width << "x" << image.height << " to a power of 2) ";
+            BuildMipLevels(image, true);
+
             glBindTexture(GL_TEXTURE_2D, textureID);
-            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
+            UploadImageLevels(image, false);
 
             // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
             // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -68,23 +79,124 @@ unsigned int loadTexture(const char *path)
         {
             std::cout << "Failed to use texture " << path << " because: " << emsg << endl;
         }
-
-        stbi_image_free(data);
     }
     else
     {
         std::cout << "Failed to load texture at path: " << path << std::endl;
-        stbi_image_free(data);
     }
 
     return textureID;
 }
 
 typedef std::map<const std::string, std::string> CubeMapPaths;
-// utility function for loading a cube map texture from file
+// the six faces of a cube map, if all of them are baked in one format and size the GPU can sample
+bool loadBakedCubemap(CubeMapPaths &cubemap, const std::string faces[6], bool flip, KtxTexture baked[6])
+{
+    for (unsigned int i = 0; i < 6; i++)
+    {
+        baked[i] = ReadKtx(cubemap[faces[i]] + ".ktx");
+        if (!baked[i].valid() || baked[i].flipped != flip || baked[i].internalFormat != baked[0].internalFormat ||
+            baked[i].width != baked[0].width || baked[i].height != baked[0].height)
+            return false;
+    }
+    return CompressedFormatSupported(baked[0].internalFormat);
+}
+
+// where the time of a cube map load went, in milliseconds; the faces are decoded on the ThreadPool while the ones that
+// are done already are uploaded, so decode and upload overlap
+struct CubemapLoadTimes
+{
+    double decode = 0.0;  // waiting for the faces (or the panorama) to be decoded
+    double project = 0.0; // the panorama onto the faces, 0 for six face images
+    double upload = 0.0;  // on the thread of the context
+};
+
+// a CubeMapPaths with this key instead of the six faces is one equirectangular panorama, see loadEquirectangularCubemap()
+const std::string CUBEMAP_EQUIRECTANGULAR = "equirectangular";
+
+// the name of a cube map in loadedAssets
+std::string cubemapName(CubeMapPaths &cubemap)
+{
+    if (cubemap.count(CUBEMAP_EQUIRECTANGULAR))
+        return "cubemap_" + cubemap[CUBEMAP_EQUIRECTANGULAR];
+    return "cubemap_" + cubemap["front"];
+}
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    auto duration = std::chrono::high_resolution_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / 1000.0;
+}
+
+// the filtering and wrapping of the bound cube map, sampled without mipmaps
+void setCubemapParameters()
+{
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
+// utility function for loading a cube map from one equirectangular panorama, projected onto faces of faceSize pixels
+// (0 picks the power of 2 closest to a quarter of the panorama's width, which keeps its resolution). The panorama is
+// projected as it is, top row up; flip turns the faces upside down afterwards, as it does the images of six faces.
 // ---------------------------------------------------
-unsigned int loadCubemap(CubeMapPaths cubemap)
+unsigned int loadEquirectangularCubemap(const char *path, bool flip = false, int faceSize = 0, CubemapLoadTimes *times = nullptr)
 {
+    CubemapLoadTimes measured;
+    auto t1 = std::chrono::high_resolution_clock::now();
+    DecodedImage image = DecodePixels(path, false, 3);
+    int width = image.width, height = image.height;
+    measured.decode = millisecondsSince(t1);
+
+    unsigned int cubeTextureID;
+    glGenTextures(1, &cubeTextureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTextureID);
+    if (image.pixels)
+    {
+        auto t2 = std::chrono::high_resolution_clock::now();
+        if (faceSize <= 0)
+            faceSize = ImageResampler::nearestPowerOf2(std::max(width / 4, 1));
+        // the faces are interpolated in linear light, as the mip levels of other textures are
+        std::vector<ImageResampler::Level> faces = ImageResampler::equirectangularToCube(image.pixels.get(), width, height, 3, true, faceSize);
+        image.pixels.reset();
+        if (flip)
+            for (ImageResampler::Level &face : faces)
+                FlipRows(face.pixels.data(), face.width, face.height, 3);
+        measured.project = millisecondsSince(t2);
+
+        auto t3 = std::chrono::high_resolution_clock::now();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (unsigned int i = 0; i < 6; i++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, faceSize, faceSize, 0, GL_RGB, GL_UNSIGNED_BYTE, faces[i].pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        measured.upload = millisecondsSince(t3);
+    }
+    else
+    {
+        std::cout << "Cubemap panorama failed to load at path: " << path << std::endl;
+    }
+    setCubemapParameters();
+
+    if (times)
+        *times = measured;
+    return cubeTextureID;
+}
+
+// utility function for loading a cube map texture from file; uses the baked <face>.ktx files if there are all six.
+// The faces are decoded on the ThreadPool and each one is uploaded as soon as it is done, so the upload of the first
+// faces overlaps the decoding of the others. Takes the panorama instead if there is a CUBEMAP_EQUIRECTANGULAR entry.
+// ---------------------------------------------------
+unsigned int loadCubemap(CubeMapPaths cubemap, bool flip = false, bool *baked = nullptr, CubemapLoadTimes *times = nullptr)
+{
+    if (baked)
+        *baked = false;
+    if (cubemap.count(CUBEMAP_EQUIRECTANGULAR))
+        return loadEquirectangularCubemap(cubemap[CUBEMAP_EQUIRECTANGULAR].c_str(), flip, 0, times);
+
+    CubemapLoadTimes measured;
+    auto t1 = std::chrono::high_resolution_clock::now();
 
     unsigned int cubeTextureID;
     glGenTextures(1, &cubeTextureID);
@@ -92,30 +204,46 @@ unsigned int loadCubemap(CubeMapPaths cubemap)
 
     std::string faces[6] = {"right", "left", "top", "bottom", "front", "back"};
 
-    // stbi_set_flip_vertically_on_load(true);
+    KtxTexture bakedFaces[6];
+    bool useBaked = loadBakedCubemap(cubemap, faces, flip, bakedFaces);
+    if (baked)
+        *baked = useBaked;
+    if (useBaked)
+    {
+        measured.decode = millisecondsSince(t1);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        // only level 0, the cube map is sampled without mipmaps
+        for (unsigned int i = 0; i < 6; i++)
+            UploadKtxLevels(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, bakedFaces[i], 1);
+        setCubemapParameters();
+        measured.upload = millisecondsSince(t2);
+        if (times)
+            *times = measured;
+        return cubeTextureID;
+    }
 
-    int width, height, nrComponents;
+    // decoded as RGB, so all faces share one format; each worker flips its face itself, see DecodePixels()
+    std::future<DecodedImage> decoded[6];
     for (unsigned int i = 0; i < 6; i++)
-    {
-        auto imgpath = cubemap[faces[i]];
-        unsigned char *image = stbi_load(imgpath.c_str(), &width, &height, &nrComponents, 0);
+        decoded[i] = GetThreadPool().submit([path = cubemap[faces[i]], flip]() { return DecodePixels(path, flip, 3); });
 
-        if (image)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-            stbi_image_free(image);
-        }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of three channels aren't padded to four bytes
+    for (unsigned int i = 0; i < 6; i++)
+    {
+        DecodedImage image = decoded[i].get();
+        auto t2 = std::chrono::high_resolution_clock::now();
+        if (image.pixels)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels.get());
         else
-        {
             std::cout << "Cubemap texture failed to load for: " << faces[i] << std::endl;
-        }
+        measured.upload += millisecondsSince(t2);
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    measured.decode = millisecondsSince(t1) - measured.upload;
+    setCubemapParameters();
 
+    if (times)
+        *times = measured;
     return cubeTextureID;
 }
 
@@ -131,17 +259,640 @@ typedef std::map<const std::string, AssetItemMap> Assets;
 // if textures should be flipped upside down use { TEX_FLIP, true }
 const std::string TEX_FLIP = "setting-flip-texture";
 
-// a std::map (global variable) that stores all the assets that need to be loaded (i.e., textures and models). Also makes sure that assets are only loaded once!
-std::map<const std::string, std::any> loadedAssets;
+// The loaded assets (i.e., textures and models) by name, which makes sure that assets are only loaded once.
+// Every entry knows the GPU and CPU memory of its asset. Entries that are not pinned and that nobody holds a handle to
+// are evicted least recently used first, once the cache exceeds its budget and evict() is called
+// (AssetManager::SetActiveGroup does).
+class AssetCache
+{
+public:
+    static constexpr size_t DEFAULT_BUDGET = (size_t)512 << 20; // bytes, GPU and CPU together
+
+    struct Stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t evictedBytes = 0;
+        size_t gpuBytes = 0; // of the assets in the cache
+        size_t cpuBytes = 0;
+        size_t entries = 0;
+    };
+
+    void setBudget(size_t bytes) { budget = bytes; }
+    size_t getBudget() const { return budget; }
+    const Stats &getStats() const { return stats; }
 
-// Helper class for textures
+    // the asset if it is cached (a hit) and of type T, otherwise null (a miss)
+    // ------------------------------------------------------------------------
+    template <class T>
+    std::shared_ptr<T> find(const std::string &name)
+    {
+        auto it = entries.find(name);
+        if (it == entries.end() || it->second.type != std::type_index(typeid(T)))
+        {
+            stats.misses++;
+            return nullptr;
+        }
+        stats.hits++;
+        it->second.lastUse = ++clock;
+        return std::static_pointer_cast<T>(it->second.resource);
+    }
+
+    bool contains(const std::string &name) const { return entries.count(name) > 0; }
+
+    // keeps an entry from being evicted, for assets handed out by reference (AssetManager::GetAsset): nothing tells
+    // when such a reference is dropped
+    void pin(const std::string &name)
+    {
+        auto it = entries.find(name);
+        if (it != entries.end())
+            it->second.pinned = true;
+    }
+
+    // adds an asset and the memory it holds; an asset of the same name is replaced
+    // ------------------------------------------------------------------------
+    template <class T>
+    void insert(const std::string &name, std::shared_ptr<T> resource, size_t gpuBytes, size_t cpuBytes)
+    {
+        erase(name);
+        Entry &entry = entries[name];
+        entry.resource = std::move(resource);
+        entry.type = std::type_index(typeid(T));
+        entry.gpuBytes = gpuBytes;
+        entry.cpuBytes = cpuBytes;
+        entry.lastUse = ++clock;
+        stats.gpuBytes += gpuBytes;
+        stats.cpuBytes += cpuBytes;
+        stats.entries = entries.size();
+    }
+
+    // evicts entries that are neither in keep, pinned nor held by a handle, least recently used first, until the cache
+    // fits its budget; returns the number of evicted entries
+    // ------------------------------------------------------------------------
+    size_t evict(const std::set<std::string> &keep = {})
+    {
+        std::vector<std::pair<std::uint64_t, std::string>> candidates;
+        for (const auto &it : entries)
+            if (!it.second.pinned && it.second.resource.use_count() == 1 && keep.count(it.first) == 0)
+                candidates.push_back({it.second.lastUse, it.first});
+        std::sort(candidates.begin(), candidates.end());
+
+        size_t evicted = 0;
+        for (const auto &candidate : candidates)
+        {
+            if (stats.gpuBytes + stats.cpuBytes <= budget)
+                break;
+            const Entry &entry = entries.at(candidate.second);
+            stats.evictedBytes += entry.gpuBytes + entry.cpuBytes;
+            erase(candidate.second);
+            stats.evictions++;
+            evicted++;
+        }
+        return evicted;
+    }
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<void> resource; // the cache holds one reference, every handle another
+        std::type_index type = std::type_index(typeid(void));
+        size_t gpuBytes = 0;
+        size_t cpuBytes = 0;
+        std::uint64_t lastUse = 0;
+        bool pinned = false;
+    };
+
+    std::map<std::string, Entry> entries;
+    size_t budget = DEFAULT_BUDGET;
+    std::uint64_t clock = 0;
+    Stats stats;
+
+    void erase(const std::string &name)
+    {
+        auto it = entries.find(name);
+        if (it == entries.end())
+            return;
+        stats.gpuBytes -= it->second.gpuBytes;
+        stats.cpuBytes -= it->second.cpuBytes;
+        entries.erase(it); // deletes the asset unless a handle still holds it
+        stats.entries = entries.size();
+    }
+};
+
+// a global variable that stores all the assets that need to be loaded, see AssetCache
+AssetCache loadedAssets;
+
+// Helper class for textures, owns the texture: it can be moved but not copied
 class Tex
 {
 private:
     unsigned int m_id; // OpenGL texture id to use with glBindTexture
 public:
     Tex(unsigned int id) : m_id{id} {}
-    operator unsigned int() { return m_id; } // cast operator
+    Tex(const Tex &) = delete;
+    Tex &operator=(const Tex &) = delete;
+    Tex(Tex &&other) noexcept : m_id{other.m_id} { other.m_id = 0; }
+    Tex &operator=(Tex &&other) noexcept
+    {
+        std::swap(m_id, other.m_id);
+        return *this;
+    }
+    ~Tex()
+    {
+        if (m_id != 0)
+            glDeleteTextures(1, &m_id);
+    }
+    operator unsigned int() const { return m_id; } // cast operator
+};
+
+// state of an asset requested with AssetManager::GetTextureAsync() or GetModelAsync()
+enum class AssetState
+{
+    Loading,   // decoding or converting on a worker thread
+    Uploading, // decoded, the upload runs in slices over the next frames
+    Ready,
+    Failed // the handle keeps resolving to the placeholder
+};
+
+// the part of an asynchronously loaded asset shared by its handles; only touched on the render thread
+template <class T>
+struct AsyncAsset
+{
+    std::string name;
+    AssetState state = AssetState::Loading;
+    std::shared_ptr<T> resource; // set once ready, shared with loadedAssets; while a handle holds it, it isn't evicted
+    T *placeholder = nullptr;
+    std::vector<std::function<void(T &)>> callbacks;
+};
+
+// Resolves to a placeholder until its asset is loaded, and to the asset from then on. Handles are cheap to copy and
+// must only be used on the render thread.
+template <class T>
+class AssetHandle
+{
+public:
+    AssetHandle() = default;
+    explicit AssetHandle(std::shared_ptr<AsyncAsset<T>> asset) : m_asset{std::move(asset)} {}
+
+    AssetState state() const { return m_asset ? m_asset->state : AssetState::Failed; }
+    bool isReady() const { return state() == AssetState::Ready; }
+
+    // the asset, or the placeholder while it is not ready; a default constructed handle has neither
+    T &get() const
+    {
+        assert(m_asset && "AssetHandle::get() on an empty handle");
+        return m_asset->resource ? *m_asset->resource : *m_asset->placeholder;
+    }
+    T &operator*() const { return get(); }
+    T *operator->() const { return &get(); }
+
+    // calls callback once the asset is ready, right away if it already is; never if the load fails
+    void onReady(std::function<void(T &)> callback) const
+    {
+        if (isReady())
+            callback(*m_asset->resource);
+        else if (state() != AssetState::Failed)
+            m_asset->callbacks.push_back(std::move(callback));
+    }
+
+private:
+    std::shared_ptr<AsyncAsset<T>> m_asset;
+};
+
+// Loads textures and models in the background. Decoding and mesh conversion run on the ThreadPool; update() picks up
+// the results on the render thread and uploads at most uploadBudget bytes per call: textures a few rows at a time and
+// level by level through pixel buffer objects (baked textures in rows of blocks), models a few meshes at a time.
+// Finished assets are added to loadedAssets.
+class AssetStreamer
+{
+public:
+    static constexpr size_t DEFAULT_UPLOAD_BUDGET = 4 << 20; // bytes per frame
+    // pixel buffers used in turn, so filling one rarely waits for the GPU to finish reading the previous one
+    static constexpr int PIXEL_BUFFER_COUNT = 3;
+
+    explicit AssetStreamer(size_t uploadBudget = DEFAULT_UPLOAD_BUDGET) : m_uploadBudget{uploadBudget} {}
+
+    ~AssetStreamer()
+    {
+        if (m_pixelBuffers[0] != 0)
+            glDeleteBuffers(PIXEL_BUFFER_COUNT, m_pixelBuffers);
+    }
+
+    AssetStreamer(const AssetStreamer &) = delete;
+    AssetStreamer &operator=(const AssetStreamer &) = delete;
+
+    void setUploadBudget(size_t bytes) { m_uploadBudget = bytes; }
+    size_t pendingCount() const { return m_textures.size() + m_models.size(); }
+
+    // a handle for a 2D texture, flipped vertically if asked to; a texture that is loaded or loading is reused
+    // ------------------------------------------------------------------------
+    AssetHandle<Tex> loadTexture(const std::string &path, bool flip)
+    {
+        if (std::shared_ptr<Tex> texture = loadedAssets.find<Tex>(path))
+            return readyHandle(path, texture, placeholderTexture());
+        for (const TextureJob &job : m_textures)
+            if (job.asset->name == path)
+                return AssetHandle<Tex>(job.asset);
+
+        TextureJob job;
+        job.asset = std::make_shared<AsyncAsset<Tex>>();
+        job.asset->name = path;
+        job.asset->placeholder = &placeholderTexture();
+        job.flip = flip;
+        job.decoded = decode(path, flip, true);
+        m_textures.push_back(std::move(job));
+        return AssetHandle<Tex>(m_textures.back().asset);
+    }
+
+    // a handle for a model, a unit cube until it is loaded; a model that is loaded or loading is reused
+    // ------------------------------------------------------------------------
+    AssetHandle<Model> loadModel(const std::string &path)
+    {
+        if (std::shared_ptr<Model> model = loadedAssets.find<Model>(path))
+            return readyHandle(path, model, proxyModel());
+        for (const ModelJob &job : m_models)
+            if (job.asset->name == path)
+                return AssetHandle<Model>(job.asset);
+
+        ModelJob job;
+        job.asset = std::make_shared<AsyncAsset<Model>>();
+        job.asset->name = path;
+        job.asset->placeholder = &proxyModel();
+        job.model = std::make_shared<Model>(path, false, false, false, false, false);
+        std::shared_ptr<Model> model = job.model;
+        job.prepared = GetThreadPool().submit([model]() { model->prepare(); });
+        m_models.push_back(std::move(job));
+        return AssetHandle<Model>(m_models.back().asset);
+    }
+
+    // call once per frame on the render thread; returns the number of assets that became ready
+    // ------------------------------------------------------------------------
+    int update()
+    {
+        int finished = 0;
+        size_t budget = m_uploadBudget;
+
+        for (size_t i = 0; i < m_textures.size();)
+        {
+            TextureJob &job = m_textures[i];
+            if (job.asset->state == AssetState::Loading && !startTextureUpload(job))
+            {
+                i++;
+                continue;
+            }
+            if (job.asset->state == AssetState::Uploading && budget > 0)
+                uploadRows(job, budget);
+            if (job.asset->state == AssetState::Ready || job.asset->state == AssetState::Failed)
+            {
+                finished += job.asset->state == AssetState::Ready ? 1 : 0;
+                m_textures.erase(m_textures.begin() + i);
+                continue;
+            }
+            i++;
+        }
+
+        for (size_t i = 0; i < m_models.size();)
+        {
+            ModelJob &job = m_models[i];
+            if (job.asset->state == AssetState::Loading)
+            {
+                if (job.prepared.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                {
+                    i++;
+                    continue;
+                }
+                try
+                {
+                    job.prepared.get();
+                }
+                catch (const std::exception &e)
+                {
+                    std::cout << "ERROR::ASSET_STREAMER : loading " << job.asset->name << " failed: " << e.what() << std::endl;
+                    job.asset->state = AssetState::Failed;
+                    m_models.erase(m_models.begin() + i);
+                    continue;
+                }
+                job.asset->state = AssetState::Uploading;
+            }
+            if (budget > 0)
+            {
+                size_t uploaded;
+                bool done = job.model->upload(budget, &uploaded);
+                budget -= std::min(budget, uploaded);
+                if (done)
+                {
+                    if (job.model->meshes.empty())
+                        job.asset->state = AssetState::Failed;
+                    else
+                    {
+                        finish(*job.asset, share(job.asset->name, job.model, job.model->gpuBytes(), job.model->cpuBytes()));
+                        finished++;
+                    }
+                    m_models.erase(m_models.begin() + i);
+                    continue;
+                }
+            }
+            i++;
+        }
+        return finished;
+    }
+
+    // an 8 x 8 checkerboard shown for textures that are not loaded (yet)
+    // ------------------------------------------------------------------------
+    Tex &placeholderTexture()
+    {
+        if (!m_placeholderTexture)
+        {
+            unsigned char pixels[8 * 8 * 3];
+            for (int i = 0; i < 8 * 8; i++)
+                std::memset(&pixels[i * 3], ((i / 8 + i % 8) % 2) ? 0xc0 : 0x40, 3);
+            unsigned int id;
+            glGenTextures(1, &id);
+            glBindTexture(GL_TEXTURE_2D, id);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 8, 8, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            m_placeholderTexture.reset(new Tex(id));
+        }
+        return *m_placeholderTexture;
+    }
+
+    // a unit cube around the origin shown for models that are not loaded (yet)
+    // ------------------------------------------------------------------------
+    Model &proxyModel()
+    {
+        if (!m_proxyModel)
+        {
+            std::vector<Vertex> vertices;
+            std::vector<unsigned int> indices;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                for (float side : {-1.0f, 1.0f})
+                {
+                    glm::vec3 normal(0.0f), u(0.0f), v(0.0f);
+                    normal[axis] = side;
+                    u[(axis + 1) % 3] = 1.0f;
+                    v[(axis + 2) % 3] = side; // keeps the triangles counter clockwise seen from outside
+                    unsigned int first = (unsigned int)vertices.size();
+                    for (int corner = 0; corner < 4; corner++)
+                    {
+                        glm::vec2 uv((float)(corner & 1), (float)(corner >> 1));
+                        Vertex vertex;
+                        vertex.Position = 0.5f * (normal + (uv.x * 2.0f - 1.0f) * u + (uv.y * 2.0f - 1.0f) * v);
+                        vertex.Normal = normal;
+                        vertex.TexCoords = uv;
+                        vertex.Tangent = u;
+                        vertex.Bitangent = v;
+                        vertices.push_back(vertex);
+                    }
+                    for (unsigned int index : {0u, 1u, 3u, 0u, 3u, 2u})
+                        indices.push_back(first + index);
+                }
+            }
+            std::vector<Mesh> meshes;
+            meshes.emplace_back(std::move(vertices), std::move(indices), std::vector<Texture>());
+            m_proxyModel.reset(new Model(std::move(meshes)));
+        }
+        return *m_proxyModel;
+    }
+
+private:
+    struct TextureJob
+    {
+        std::shared_ptr<AsyncAsset<Tex>> asset;
+        std::future<DecodedImage> decoded;
+        DecodedImage image;
+        bool flip = false;
+        unsigned int texture = 0;
+        GLenum format = GL_RGB;
+        int level = 0;
+        int nextRow = 0; // of blocks for baked textures
+    };
+
+    struct ModelJob
+    {
+        std::shared_ptr<AsyncAsset<Model>> asset;
+        std::future<void> prepared;
+        std::shared_ptr<Model> model;
+    };
+
+    size_t m_uploadBudget;
+    std::vector<TextureJob> m_textures;
+    std::vector<ModelJob> m_models;
+    GLuint m_pixelBuffers[PIXEL_BUFFER_COUNT] = {};
+    int m_nextPixelBuffer = 0;
+    std::unique_ptr<Tex> m_placeholderTexture;
+    std::unique_ptr<Model> m_proxyModel;
+
+    template <class T>
+    static AssetHandle<T> readyHandle(const std::string &name, const std::shared_ptr<T> &resource, T &placeholder)
+    {
+        auto asset = std::make_shared<AsyncAsset<T>>();
+        asset->name = name;
+        asset->state = AssetState::Ready;
+        asset->resource = resource;
+        asset->placeholder = &placeholder;
+        return AssetHandle<T>(asset);
+    }
+
+    template <class T>
+    static void finish(AsyncAsset<T> &asset, const std::shared_ptr<T> &resource)
+    {
+        asset.resource = resource;
+        asset.state = AssetState::Ready;
+        for (auto &callback : asset.callbacks)
+            callback(*resource);
+        asset.callbacks.clear();
+    }
+
+    // decodes on a worker, preferring a baked texture if allowBaked, and builds the mip chain there as loadTexture()
+    // would; the rows are flipped by DecodePixels(), never by stb_image's global setting
+    static std::future<DecodedImage> decode(const std::string &path, bool flip, bool allowBaked)
+    {
+        return GetThreadPool().submit([path, flip, allowBaked]()
+                                      {
+                                          DecodedImage image;
+                                          if (allowBaked)
+                                              image = DecodeImage(path, flip, true);
+                                          else
+                                          {
+                                              image = DecodePixels(path, flip);
+                                              image.srgb = true;
+                                          }
+                                          BuildMipLevels(image, true);
+                                          return image;
+                                      });
+    }
+
+    // once the worker is done: checks the image like loadTexture() does and creates every level without data;
+    // returns false while the worker is still decoding
+    bool startTextureUpload(TextureJob &job)
+    {
+        if (job.decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+        job.image = job.decoded.get();
+        if (job.image.baked.valid())
+            return startBakedUpload(job);
+        const char *error = nullptr;
+        if (job.image.levels.empty())
+            error = "Failed to load texture at path: ";
+        else if (job.image.channels == 1)
+            job.format = GL_RED;
+        else if (job.image.channels == 3)
+            job.format = GL_RGB;
+        else if (job.image.channels == 4)
+            job.format = GL_RGBA;
+        else
+            error = "Number of Channels not supported: ";
+        if (error)
+        {
+            std::cout << error << job.asset->name << std::endl;
+            job.asset->state = AssetState::Failed;
+            return true;
+        }
+
+        glGenTextures(1, &job.texture);
+        glBindTexture(GL_TEXTURE_2D, job.texture);
+        for (size_t level = 0; level < job.image.levels.size(); level++)
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, job.format, job.image.levels[level].width, job.image.levels[level].height, 0, job.format, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)job.image.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        job.asset->state = AssetState::Uploading;
+        return true;
+    }
+
+    // creates the texture of a baked image with undefined contents in every level; if the GPU can't sample its format,
+    // the image is decoded after all and false is returned until that is done
+    bool startBakedUpload(TextureJob &job)
+    {
+        const KtxTexture &baked = job.image.baked;
+        if (!CompressedFormatSupported(baked.internalFormat))
+        {
+            job.image = DecodedImage();
+            job.decoded = decode(job.asset->name, job.flip, false);
+            return false;
+        }
+        glGenTextures(1, &job.texture);
+        glBindTexture(GL_TEXTURE_2D, job.texture);
+        for (int level = 0; level < (int)baked.levels.size(); level++)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, baked.internalFormat, baked.levelWidth(level), baked.levelHeight(level), 0,
+                                   (GLsizei)baked.levels[level].size, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)baked.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, baked.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        job.asset->state = AssetState::Uploading;
+        return true;
+    }
+
+    // copies bytes into the next pixel buffer and leaves it bound to GL_PIXEL_UNPACK_BUFFER; false if it can't be mapped
+    bool fillPixelBuffer(const unsigned char *data, size_t bytes)
+    {
+        if (m_pixelBuffers[0] == 0)
+            glGenBuffers(PIXEL_BUFFER_COUNT, m_pixelBuffers);
+
+        // orphaning the buffer lets the driver hand out fresh memory if the GPU still reads the old contents
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffers[m_nextPixelBuffer]);
+        m_nextPixelBuffer = (m_nextPixelBuffer + 1) % PIXEL_BUFFER_COUNT;
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!mapped)
+            return false;
+        std::memcpy(mapped, data, bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        return true;
+    }
+
+    // copies as many rows as the budget allows (at least one) into a pixel buffer and from there into the texture,
+    // level by level; the levels were built by the worker, so no mipmaps are generated here
+    void uploadRows(TextureJob &job, size_t &budget)
+    {
+        if (job.image.baked.valid())
+        {
+            uploadBlockRows(job, budget);
+            return;
+        }
+        const ImageResampler::Level &mip = job.image.levels[job.level];
+        size_t rowBytes = (size_t)mip.width * job.image.channels;
+        int rows = (int)std::min<size_t>(std::max<size_t>(budget / rowBytes, 1), (size_t)(mip.height - job.nextRow));
+        size_t bytes = rows * rowBytes;
+        if (fillPixelBuffer(mip.pixels.data() + job.nextRow * rowBytes, bytes))
+        {
+            glBindTexture(GL_TEXTURE_2D, job.texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, job.level, 0, job.nextRow, mip.width, rows, job.format, GL_UNSIGNED_BYTE, nullptr);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            job.nextRow += rows;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        budget -= std::min(budget, bytes);
+
+        if (job.nextRow < mip.height)
+            return;
+        job.level++;
+        job.nextRow = 0;
+        if (job.level < (int)job.image.levels.size())
+            return;
+        finishTexture(job);
+    }
+
+    // the same for a baked texture, in rows of 4x4 blocks; the levels come as they are, no mipmaps are generated
+    void uploadBlockRows(TextureJob &job, size_t &budget)
+    {
+        const KtxTexture &baked = job.image.baked;
+        int width = baked.levelWidth(job.level), height = baked.levelHeight(job.level);
+        int blockRows = (height + 3) / 4;
+        size_t rowBytes = baked.levels[job.level].size / blockRows;
+        int rows = (int)std::min<size_t>(std::max<size_t>(budget / rowBytes, 1), (size_t)(blockRows - job.nextRow));
+        size_t bytes = rows * rowBytes;
+        if (fillPixelBuffer(baked.levelData(job.level) + job.nextRow * rowBytes, bytes))
+        {
+            glBindTexture(GL_TEXTURE_2D, job.texture);
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, job.level, 0, job.nextRow * 4, width, std::min(rows * 4, height - job.nextRow * 4),
+                                      baked.internalFormat, (GLsizei)bytes, nullptr);
+            job.nextRow += rows;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        budget -= std::min(budget, bytes);
+
+        if (job.nextRow < blockRows)
+            return;
+        job.level++;
+        job.nextRow = 0;
+        if (job.level < (int)baked.levels.size())
+            return;
+        finishTexture(job);
+    }
+
+    void finishTexture(TextureJob &job)
+    {
+        job.image = DecodedImage();
+        auto texture = std::make_shared<Tex>(job.texture);
+        finish(*job.asset, share(job.asset->name, texture, TextureBytes(job.texture), 0));
+    }
+
+    // adds a finished asset to loadedAssets; if GetAsset loaded it meanwhile, that one is used and resource is dropped,
+    // as the references GetAsset handed out must stay valid
+    template <class T>
+    static std::shared_ptr<T> share(const std::string &name, std::shared_ptr<T> resource, size_t gpuBytes, size_t cpuBytes)
+    {
+        if (!loadedAssets.contains(name))
+        {
+            loadedAssets.insert(name, resource, gpuBytes, cpuBytes);
+            return resource;
+        }
+        std::shared_ptr<T> loaded = loadedAssets.find<T>(name);
+        return loaded ? loaded : resource;
+    }
 };
 
 class AssetManager
@@ -149,6 +900,8 @@ class AssetManager
 private:
     Assets m_assets;
     std::string m_active;
+    AssetStreamer m_streamer;
+    bool m_flipTextures = false; // the flip setting of the group GetAsset<Tex> loads from
 
     // checks if there is a TEX_FLIP="setting-flip-texture" key in the group and check if it is boolean
     bool flipImagesForGroup(const std::string &group)
@@ -160,6 +913,20 @@ private:
             return false; // if key is not set we assume no flipping!
     }
 
+    // the names the assets of a group have in loadedAssets
+    std::set<std::string> AssetNames(const std::string &group)
+    {
+        std::set<std::string> names;
+        for (auto &item : m_assets.at(group))
+        {
+            if (item.second.type() == typeid(const char *))
+                names.insert(std::any_cast<const char *>(item.second));
+            else if (item.second.type() == typeid(CubeMapPaths))
+                names.insert(cubemapName(std::any_cast<CubeMapPaths &>(item.second)));
+        }
+        return names;
+    }
+
     bool GroupExists(const std::string &group)
     {
         if (m_assets.find(group) != m_assets.end()) // key found
@@ -169,11 +936,11 @@ private:
     }
 
     template <class T>
-    T Convert(std::any &r)
+    T &Convert(std::any &r)
     {
         try
         {
-            return std::any_cast<T>(r);
+            return std::any_cast<T &>(r);
         }
         catch (const std::bad_any_cast &e)
         {
@@ -185,25 +952,44 @@ private:
     }
 
     template <>
-    Model Convert(std::any &r)
+    Model &Convert(std::any &r)
     {
         try
         {
             auto path = std::any_cast<const char *>(r);
 
-            if (loadedAssets.count(path) <= 0) // not loaded yet (lazy init)
+            std::shared_ptr<Model> m = loadedAssets.find<Model>(path);
+            if (!m) // not loaded yet (lazy init)
             {
                 std::cout << "Loading Model " << path << " ... ";
                 auto t1 = std::chrono::high_resolution_clock::now();
-                Model *m = new Model(path);
-                loadedAssets.insert(std::pair<const std::string, std::any>(path, *m));
+                m = std::make_shared<Model>(path);
+                loadedAssets.insert(path, m, m->gpuBytes(), m->cpuBytes());
                 auto t2 = std::chrono::high_resolution_clock::now();
                 auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
 
-                std::cout << "done (in " << (duration / 1000) << " milliseconds)." << std::endl;
+                std::cout << "done (in " << (duration / 1000) << " milliseconds";
+                if (m->loadTimes.fromCache)
+                    std::cout << ", from the model cache";
+                else
+                    std::cout << ": parse " << (int)m->loadTimes.parse << ", convert " << (int)m->loadTimes.convert << ", upload " << (int)m->loadTimes.upload;
+                if (m->vertexBytesSaved > 0)
+                    std::cout << ", " << (m->vertexBytesSaved / 1024) << " KB of vertex data saved";
+                if (m->cpuBytesReleased > 0)
+                    std::cout << ", " << (m->cpuBytesReleased / 1024) << " KB of CPU mesh data released";
+                std::cout << ")." << std::endl;
+                for (size_t i = 0; i < m->optimizationStats.size(); i++)
+                {
+                    const MeshOptimizationStats &stats = m->optimizationStats[i];
+                    char line[160];
+                    std::snprintf(line, sizeof(line), "  mesh %zu: %zu triangles, vertices %zu -> %zu, ACMR %.3f -> %.3f, overdraw %.3f -> %.3f",
+                                  i, stats.triangles, stats.verticesBefore, stats.verticesAfter, stats.acmrBefore, stats.acmrAfter,
+                                  stats.overdrawBefore, stats.overdrawAfter);
+                    std::cout << line << std::endl;
+                }
             }
-            auto m = std::any_cast<Model &>(loadedAssets.at(path));
-            return m;
+            loadedAssets.pin(path); // the reference is handed out, see GetAsset
+            return *m;
         }
         catch (const std::bad_any_cast &e)
         {
@@ -213,25 +999,33 @@ private:
     }
 
     template <>
-    Tex Convert(std::any &r)
+    Tex &Convert(std::any &r)
     {
         try
         { // handle 6 face cube maps
             auto cubemap = std::any_cast<CubeMapPaths>(r);
-            auto uniquename = "cubemap_" + cubemap["front"];
+            auto uniquename = cubemapName(cubemap);
 
-            if (loadedAssets.count(uniquename) <= 0) // not loaded yet (lazy init)
+            std::shared_ptr<Tex> c = loadedAssets.find<Tex>(uniquename);
+            if (!c) // not loaded yet (lazy init)
             {
                 std::cout << "Loading CubeMap " << uniquename << " ... ";
                 auto t1 = std::chrono::high_resolution_clock::now();
-                loadedAssets.insert(std::pair<const std::string, std::any>(uniquename, Tex(loadCubemap(cubemap))));
+                bool baked;
+                CubemapLoadTimes times;
+                c = std::make_shared<Tex>(loadCubemap(cubemap, m_flipTextures, &baked, &times));
+                size_t bytes = TextureBytes(*c, GL_TEXTURE_CUBE_MAP);
+                loadedAssets.insert(uniquename, c, bytes, 0);
                 auto t2 = std::chrono::high_resolution_clock::now();
                 auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
 
-                std::cout << "done (in " << (duration / 1000) << " milliseconds)." << std::endl;
+                std::cout << "done (in " << (duration / 1000) << " milliseconds: decode " << (int)times.decode;
+                if (times.project > 0.0)
+                    std::cout << ", project " << (int)times.project;
+                std::cout << ", upload " << (int)times.upload << ", " << (baked ? "baked, " : "") << (bytes / 1024) << " KB)." << std::endl;
             }
-            auto c = std::any_cast<Tex>(loadedAssets.at(uniquename));
-            return c;
+            loadedAssets.pin(uniquename);
+            return *c;
         }
         catch (const std::bad_any_cast) // if not a cube map
         {
@@ -239,18 +1033,22 @@ private:
             { // handle 2D textures
                 auto path = std::any_cast<const char *>(r);
 
-                if (loadedAssets.count(path) <= 0) // not loaded yet (lazy init)
+                std::shared_ptr<Tex> t = loadedAssets.find<Tex>(path);
+                if (!t) // not loaded yet (lazy init)
                 {
                     std::cout << "Loading Texture " << path << " ... ";
                     auto t1 = std::chrono::high_resolution_clock::now();
-                    loadedAssets.insert(std::pair<const std::string, std::any>(path, Tex(loadTexture(path))));
+                    bool baked;
+                    t = std::make_shared<Tex>(loadTexture(path, m_flipTextures, &baked));
+                    size_t bytes = TextureBytes(*t);
+                    loadedAssets.insert(path, t, bytes, 0);
                     auto t2 = std::chrono::high_resolution_clock::now();
                     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
 
-                    std::cout << "done (in " << (duration / 1000) << " milliseconds)." << std::endl;
+                    std::cout << "done (in " << (duration / 1000) << " milliseconds, " << (baked ? "baked, " : "") << (bytes / 1024) << " KB)." << std::endl;
                 }
-                auto t = std::any_cast<Tex>(loadedAssets.at(path));
-                return t;
+                loadedAssets.pin(path);
+                return *t;
             }
             catch (const std::bad_any_cast &e)
             {
@@ -263,24 +1061,52 @@ private:
 public:
     AssetManager(const Assets assets) : m_assets{assets} { m_active = m_assets.begin()->first; }
 
+    // the asset is loaded once and pinned in loadedAssets, it is never evicted and the reference remains valid
     template <class T>
-    T GetAsset(const std::string &group, const std::string &name)
+    T &GetAsset(const std::string &group, const std::string &name)
     {
         return Convert<T>(m_assets.at(group).at(name));
     }
 
     // Textures need a specialized function, due to the possiblity of flipping it vertically
     template <>
-    Tex GetAsset(const std::string &group, const std::string &name)
+    Tex &GetAsset(const std::string &group, const std::string &name)
+    {
+        // Optionally flip loaded textures on the y-axis; the loaders flip the rows themselves, stb_image's setting
+        // is global and would leak into the decodes running on the ThreadPool
+        m_flipTextures = flipImagesForGroup(group); // baked textures have to be baked flipped as well
+        Tex &texture = Convert<Tex>(m_assets.at(group).at(name));
+        m_flipTextures = false;
+        return texture;
+    }
+
+    // starts loading a texture in the background and returns right away; the handle resolves to a placeholder until
+    // the texture is ready. Cube maps are loaded right away. Call UpdateStreaming() once per frame.
+    AssetHandle<Tex> GetTextureAsync(const std::string &group, const std::string &name)
     {
-        // Optionally tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
-        stbi_set_flip_vertically_on_load(flipImagesForGroup(group));
+        std::any &r = m_assets.at(group).at(name);
+        if (r.type() == typeid(CubeMapPaths))
+        {
+            GetAsset<Tex>(group, name);
+            auto uniquename = cubemapName(std::any_cast<CubeMapPaths &>(r));
+            return m_streamer.loadTexture(uniquename, false); // loaded, so this only wraps it
+        }
+        return m_streamer.loadTexture(Convert<const char *>(r), flipImagesForGroup(group));
+    }
 
-        return Convert<Tex>(m_assets.at(group).at(name));
+    // starts loading a model in the background and returns right away; the handle resolves to a unit cube until the
+    // model is ready. Call UpdateStreaming() once per frame.
+    AssetHandle<Model> GetModelAsync(const std::string &group, const std::string &name)
+    {
+        return m_streamer.loadModel(Convert<const char *>(m_assets.at(group).at(name)));
     }
 
+    // finishes the background loads, uploading at most the streamer's budget; returns the number of assets that became ready
+    int UpdateStreaming() { return m_streamer.update(); }
+    AssetStreamer &GetStreamer() { return m_streamer; }
+
     template <class T>
-    T GetActiveAsset(const std::string &name)
+    T &GetActiveAsset(const std::string &name)
     {
         return GetAsset<T>(m_active, name);
     }
@@ -295,14 +1121,21 @@ public:
         return keys;
     }
 
+    // switching groups evicts the assets of the other groups that were loaded by GetTextureAsync or GetModelAsync and
+    // that no AssetHandle holds anymore, as far as loadedAssets is over its budget; assets returned by GetAsset stay
     void SetActiveGroup(const std::string &group)
     {
         // make sure the group exists!
         if (!GroupExists(group))
             return;
         m_active = group;
+        loadedAssets.evict(AssetNames(group));
     }
 
+    // hits, misses, evictions and the memory held by the loaded assets
+    const AssetCache::Stats &GetCacheStats() const { return loadedAssets.getStats(); }
+    void SetCacheBudget(size_t bytes) { loadedAssets.setBudget(bytes); }
+
     void SetActiveGroup(const int id) { SetActiveGroup(GetGroups().at(id)); }
     const std::string GetActiveGroup() { return m_active; }
     const int GetActiveGroupId()
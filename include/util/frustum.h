@@ -0,0 +1,69 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// The six planes of a view frustum, extracted from a clip matrix (Gribb/Hartmann).
+// Tests happen in the space the matrix transforms from: with projection * view * model the bounds are given in model space.
+class Frustum
+{
+public:
+    enum Result
+    {
+        OUTSIDE,
+        INTERSECTS,
+        INSIDE
+    };
+
+    // planes as (normal, distance), the normals point into the frustum
+    glm::vec4 planes[6];
+
+    Frustum(const glm::mat4 &clip)
+    {
+        // the rows of the clip matrix
+        glm::mat4 rows = glm::transpose(clip);
+        planes[0] = rows[3] + rows[0]; // left
+        planes[1] = rows[3] - rows[0]; // right
+        planes[2] = rows[3] + rows[1]; // bottom
+        planes[3] = rows[3] - rows[1]; // top
+        planes[4] = rows[3] + rows[2]; // near
+        planes[5] = rows[3] - rows[2]; // far
+
+        for (int i = 0; i < 6; i++)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+    // classifies an axis aligned box against the frustum
+    Result testBox(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+    {
+        Result result = INSIDE;
+        for (int i = 0; i < 6; i++)
+        {
+            glm::vec3 normal = glm::vec3(planes[i]);
+            // the corner furthest along the plane normal and the one opposite to it
+            glm::vec3 positive = glm::vec3(normal.x >= 0.0f ? boxMax.x : boxMin.x, normal.y >= 0.0f ? boxMax.y : boxMin.y, normal.z >= 0.0f ? boxMax.z : boxMin.z);
+            glm::vec3 negative = glm::vec3(normal.x >= 0.0f ? boxMin.x : boxMax.x, normal.y >= 0.0f ? boxMin.y : boxMax.y, normal.z >= 0.0f ? boxMin.z : boxMax.z);
+            if (glm::dot(normal, positive) + planes[i].w < 0.0f)
+                return OUTSIDE;
+            if (glm::dot(normal, negative) + planes[i].w < 0.0f)
+                result = INTERSECTS;
+        }
+        return result;
+    }
+
+    // classifies a bounding sphere against the frustum
+    Result testSphere(const glm::vec3 &center, float radius) const
+    {
+        Result result = INSIDE;
+        for (int i = 0; i < 6; i++)
+        {
+            float distance = glm::dot(glm::vec3(planes[i]), center) + planes[i].w;
+            if (distance < -radius)
+                return OUTSIDE;
+            if (distance < radius)
+                result = INTERSECTS;
+        }
+        return result;
+    }
+};
+#endif
@@ -0,0 +1,201 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <glm/glm.hpp>
+
+#include <util/threadpool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HEIGHTFIELD_SSE2
+#endif
+
+// A ripple simulation on a grid of heights. The 2D wave equation is integrated at a fixed rate, any number of ripple
+// sources disturb the surface and damping lets the waves fade out again. The cost does not depend on the number of
+// ripples: bands of rows are simulated in parallel on the thread pool, four cells at a time with SSE2.
+class Heightfield
+{
+public:
+    // simulation parameters
+    float waveSpeed = 0.35f;      // (c * dt / dx)^2, has to stay below 0.5 for the simulation to be stable
+    float damping = 0.985f;       // applied every step, makes the ripples fade out
+    float frequency = 1.5f;       // oscillations per second of a ripple source
+    float stepsPerSecond = 60.0f; // fixed rate of the integration
+
+    Heightfield(int width, int height, int tileSize, float maxHeight)
+        : width(width), height(height), tileSize(tileSize), maxHeight(maxHeight)
+    {
+        current.assign((size_t)width * height, 0.0f);
+        previous.assign((size_t)width * height, 0.0f);
+        tilesX = (width + tileSize - 1) / tileSize;
+        tilesY = (height + tileSize - 1) / tileSize;
+        tileMax.assign((size_t)tilesX * tilesY, 0.0f);
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // the heights of the last step, row by row
+    const float *data() const { return current.data(); }
+
+    // largest absolute height within a tile after the last step; tiles below a small threshold are flat
+    float tileMaxHeight(int tileX, int tileY) const { return tileMax[tileY * tilesX + tileX]; }
+
+    // adds a ripple at the given (fractional) cell: it oscillates with the given amplitude, which decays with decay (1/s)
+    // ------------------------------------------------------------------------
+    void addRipple(const glm::vec2 &cell, float amplitude, float decay = 1.5f, float radius = 2.0f)
+    {
+        ripples.push_back({cell, amplitude, decay, radius, 0.0f});
+    }
+
+    // the source that follows the mouse; it is moved instead of added and does not decay
+    // ------------------------------------------------------------------------
+    void setHoverSource(const glm::vec2 &cell, float amplitude, float radius = 2.0f)
+    {
+        hover.cell = cell;
+        hover.amplitude = amplitude;
+        hover.radius = radius;
+        hoverActive = true;
+    }
+    void clearHoverSource() { hoverActive = false; }
+
+    size_t rippleCount() const { return ripples.size() + (hoverActive ? 1 : 0); }
+
+    // advances the simulation by deltaTime seconds and returns the number of steps taken
+    // ------------------------------------------------------------------------
+    int update(float deltaTime)
+    {
+        const float stepTime = 1.0f / stepsPerSecond;
+        accumulator = std::min(accumulator + deltaTime, 4.0f * stepTime); // don't try to catch up after a hitch
+        int steps = 0;
+        while (accumulator >= stepTime)
+        {
+            accumulator -= stepTime;
+            step(stepTime);
+            steps++;
+        }
+        return steps;
+    }
+
+private:
+    struct Ripple
+    {
+        glm::vec2 cell;
+        float amplitude;
+        float decay;
+        float radius;
+        float age;
+    };
+
+    int width, height;
+    int tileSize, tilesX, tilesY;
+    float maxHeight;
+    float accumulator = 0.0f;
+
+    std::vector<float> current;  // heights of the last step
+    std::vector<float> previous; // heights of the step before, overwritten with the next step
+    std::vector<float> tileMax;
+    std::vector<Ripple> ripples;
+    Ripple hover = {};
+    bool hoverActive = false;
+
+    void step(float stepTime)
+    {
+        // sources pull the surface towards their current elongation, weighted by a gaussian footprint
+        const float omega = 2.0f * 3.14159265f * frequency;
+        hover.age += stepTime;
+        if (hoverActive)
+            inject(hover, hover.amplitude * std::sin(omega * hover.age));
+        for (auto &ripple : ripples)
+        {
+            ripple.age += stepTime;
+            inject(ripple, ripple.amplitude * std::exp(-ripple.decay * ripple.age) * std::sin(omega * ripple.age));
+        }
+        ripples.erase(std::remove_if(ripples.begin(), ripples.end(), [](const Ripple &r)
+                                     { return r.amplitude * std::exp(-r.decay * r.age) < 0.01f; }),
+                      ripples.end());
+
+        // every band of tile rows is one slice, so the tile maxima are written by a single thread
+        GetThreadPool().parallelFor(0, tilesY, [this](int first, int last)
+                                    {
+                                        for (int tileY = first; tileY < last; tileY++)
+                                            simulateBand(tileY);
+                                    });
+        std::swap(current, previous);
+    }
+
+    void inject(const Ripple &ripple, float elongation)
+    {
+        int reach = (int)std::ceil(ripple.radius * 2.0f);
+        int x0 = std::max(0, (int)ripple.cell.x - reach), x1 = std::min(width - 1, (int)ripple.cell.x + reach);
+        int y0 = std::max(0, (int)ripple.cell.y - reach), y1 = std::min(height - 1, (int)ripple.cell.y + reach);
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                float dx = x - ripple.cell.x, dy = y - ripple.cell.y;
+                float weight = std::exp(-(dx * dx + dy * dy) / (ripple.radius * ripple.radius));
+                float &h = current[(size_t)y * width + x];
+                h += (elongation - h) * weight;
+            }
+        }
+    }
+
+    // one cell of the discrete wave equation: next = (2h - prev + k * laplacian(h)) * damping
+    float stepCell(float h, float left, float right, float up, float down, float prev) const
+    {
+        float next = ((2.0f - 4.0f * waveSpeed) * h + waveSpeed * (left + right + up + down) - prev) * damping;
+        return std::min(std::max(next, -maxHeight), maxHeight);
+    }
+
+    void simulateBand(int tileY)
+    {
+        for (int tileX = 0; tileX < tilesX; tileX++)
+            tileMax[tileY * tilesX + tileX] = 0.0f;
+
+        int yEnd = std::min(height, (tileY + 1) * tileSize);
+        for (int y = tileY * tileSize; y < yEnd; y++)
+        {
+            // the border reflects: missing neighbors are replaced by the cell itself
+            const float *row = &current[(size_t)y * width];
+            const float *up = &current[(size_t)std::max(y - 1, 0) * width];
+            const float *down = &current[(size_t)std::min(y + 1, height - 1) * width];
+            float *next = &previous[(size_t)y * width]; // holds the previous step until it is overwritten
+
+            next[0] = stepCell(row[0], row[0], row[std::min(1, width - 1)], up[0], down[0], next[0]);
+            int x = 1;
+#ifdef HEIGHTFIELD_SSE2
+            const __m128 k = _mm_set1_ps(waveSpeed);
+            const __m128 center = _mm_set1_ps(2.0f - 4.0f * waveSpeed);
+            const __m128 damp = _mm_set1_ps(damping);
+            const __m128 upper = _mm_set1_ps(maxHeight);
+            const __m128 lower = _mm_set1_ps(-maxHeight);
+            for (; x + 4 <= width - 1; x += 4)
+            {
+                __m128 neighbors = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row + x - 1), _mm_loadu_ps(row + x + 1)),
+                                              _mm_add_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x)));
+                __m128 value = _mm_add_ps(_mm_mul_ps(center, _mm_loadu_ps(row + x)), _mm_mul_ps(k, neighbors));
+                value = _mm_mul_ps(_mm_sub_ps(value, _mm_loadu_ps(next + x)), damp);
+                _mm_storeu_ps(next + x, _mm_min_ps(_mm_max_ps(value, lower), upper));
+            }
+#endif
+            for (; x < width - 1; x++)
+                next[x] = stepCell(row[x], row[x - 1], row[x + 1], up[x], down[x], next[x]);
+            if (width > 1)
+                next[width - 1] = stepCell(row[width - 1], row[width - 2], row[width - 1], up[width - 1], down[width - 1], next[width - 1]);
+
+            for (int tileX = 0; tileX < tilesX; tileX++)
+            {
+                float &m = tileMax[tileY * tilesX + tileX];
+                int xEnd = std::min(width, (tileX + 1) * tileSize);
+                for (int i = tileX * tileSize; i < xEnd; i++)
+                    m = std::max(m, std::abs(next[i]));
+            }
+        }
+    }
+};
+#endif
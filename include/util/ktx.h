@@ -0,0 +1,237 @@
+#ifndef KTX_H
+#define KTX_H
+
+#include <glad/glad.h>
+
+#include <util/texcompress.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+// A block compressed 2D texture with its mip chain, as stored in a KTX (version 1.1) file by tex-bake. Reading and
+// writing don't touch OpenGL and can run on any thread; TextureFromKtx() hands the blocks to glCompressedTexImage2D as
+// they are, so nothing is decoded or generated at load time.
+struct KtxTexture
+{
+    struct Level
+    {
+        size_t offset; // into data
+        size_t size;
+    };
+
+    GLenum internalFormat = 0; // GL_COMPRESSED_*, 0 if nothing was read
+    GLenum baseFormat = 0;
+    int width = 0, height = 0;
+    bool flipped = false; // bottom row first, like images loaded with stbi_set_flip_vertically_on_load(true)
+    std::vector<Level> levels;
+    std::vector<unsigned char> data;
+
+    bool valid() const { return internalFormat != 0 && !levels.empty(); }
+    int levelWidth(int level) const { return std::max(width >> level, 1); }
+    int levelHeight(int level) const { return std::max(height >> level, 1); }
+    const unsigned char *levelData(int level) const { return data.data() + levels[level].offset; }
+};
+
+// the fixed part of the file after the identifier; all values in the byte order of the writer
+struct KtxHeader
+{
+    std::uint32_t endianness, glType, glTypeSize, glFormat, glInternalFormat, glBaseInternalFormat;
+    std::uint32_t pixelWidth, pixelHeight, pixelDepth, numberOfArrayElements, numberOfFaces, numberOfMipmapLevels;
+    std::uint32_t bytesOfKeyValueData;
+};
+
+const unsigned char KTX_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+const std::uint32_t KTX_ENDIANNESS = 0x04030201;
+
+// key/value pairs and images are padded to 4 bytes
+inline size_t KtxPadded(size_t size) { return (size + 3) & ~(size_t)3; }
+
+// reads a baked texture; returns an invalid texture if the file is missing or not a compressed 2D texture
+// ------------------------------------------------------------------------
+inline KtxTexture ReadKtx(const std::string &path)
+{
+    KtxTexture texture;
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return texture;
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    KtxHeader header;
+    if (bytes.size() < sizeof(KTX_IDENTIFIER) + sizeof(header) || std::memcmp(bytes.data(), KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0)
+        return texture;
+    std::memcpy(&header, bytes.data() + sizeof(KTX_IDENTIFIER), sizeof(header));
+    if (header.endianness != KTX_ENDIANNESS || header.glType != 0 || header.pixelDepth > 1 || header.numberOfArrayElements != 0 ||
+        header.numberOfFaces != 1 || header.numberOfMipmapLevels == 0 || header.pixelWidth == 0 || header.pixelHeight == 0)
+        return texture;
+
+    // the only key read is the orientation, "S=r,T=d" (top row first) unless it says otherwise
+    size_t position = sizeof(KTX_IDENTIFIER) + sizeof(header);
+    size_t keyValueEnd = position + header.bytesOfKeyValueData;
+    bool flipped = false;
+    while (position + 4 <= keyValueEnd && keyValueEnd <= bytes.size())
+    {
+        std::uint32_t size;
+        std::memcpy(&size, bytes.data() + position, 4);
+        if (position + 4 + size > keyValueEnd)
+            return texture;
+        std::string pair((const char *)bytes.data() + position + 4, size);
+        size_t separator = pair.find('\0');
+        if (separator != std::string::npos && pair.compare(0, separator, "KTXorientation") == 0)
+            flipped = pair.find("T=u", separator) != std::string::npos;
+        position += 4 + KtxPadded(size);
+    }
+    position = keyValueEnd;
+
+    std::vector<KtxTexture::Level> levels;
+    for (std::uint32_t level = 0; level < header.numberOfMipmapLevels; level++)
+    {
+        std::uint32_t size;
+        if (position + 4 > bytes.size())
+            return texture;
+        std::memcpy(&size, bytes.data() + position, 4);
+        position += 4;
+        if (size == 0 || position + size > bytes.size())
+            return texture;
+        levels.push_back({position, size});
+        position += KtxPadded(size);
+    }
+
+    texture.internalFormat = header.glInternalFormat;
+    texture.baseFormat = header.glBaseInternalFormat;
+    texture.width = (int)header.pixelWidth;
+    texture.height = (int)header.pixelHeight;
+    texture.flipped = flipped;
+    texture.levels = std::move(levels);
+    texture.data = std::move(bytes);
+    return texture;
+}
+
+// writes a texture whose data holds its levels one after another; returns false if the file can't be written
+// ------------------------------------------------------------------------
+inline bool WriteKtx(const std::string &path, const KtxTexture &texture)
+{
+    std::string orientation = std::string("KTXorientation") + '\0' + (texture.flipped ? "S=r,T=u" : "S=r,T=d") + '\0';
+    std::uint32_t orientationSize = (std::uint32_t)orientation.size();
+    orientation.resize(KtxPadded(orientation.size()), '\0');
+
+    KtxHeader header = {};
+    header.endianness = KTX_ENDIANNESS;
+    header.glTypeSize = 1;
+    header.glInternalFormat = texture.internalFormat;
+    header.glBaseInternalFormat = texture.baseFormat;
+    header.pixelWidth = (std::uint32_t)texture.width;
+    header.pixelHeight = (std::uint32_t)texture.height;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = (std::uint32_t)texture.levels.size();
+    header.bytesOfKeyValueData = (std::uint32_t)(4 + orientation.size());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file.write((const char *)KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    file.write((const char *)&header, sizeof(header));
+    file.write((const char *)&orientationSize, 4);
+    file.write(orientation.data(), orientation.size());
+    for (size_t level = 0; level < texture.levels.size(); level++)
+    {
+        std::uint32_t size = (std::uint32_t)texture.levels[level].size;
+        static const char padding[3] = {};
+        file.write((const char *)&size, 4);
+        file.write((const char *)texture.levelData((int)level), size);
+        file.write(padding, KtxPadded(size) - size);
+    }
+    return (bool)file;
+}
+
+// the sRGB variant of a compressed color format, so sampling returns linear light; RGTC (BC4/BC5) has none and is
+// returned as it is, like formats that are sRGB already
+// ------------------------------------------------------------------------
+inline GLenum CompressedSrgbFormat(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+    default:
+        return internalFormat;
+    }
+}
+
+// true if the current context can sample textures of a compressed format; RGTC (BC4/BC5) is core since OpenGL 3.0
+// ------------------------------------------------------------------------
+inline bool CompressedFormatSupported(GLenum internalFormat)
+{
+    static const std::set<std::string> extensions = []()
+    {
+        std::set<std::string> names;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+            names.insert((const char *)glGetStringi(GL_EXTENSIONS, (GLuint)i));
+        return names;
+    }();
+    switch (internalFormat)
+    {
+    case GL_COMPRESSED_RED_RGTC1:
+    case GL_COMPRESSED_RG_RGTC2:
+        return true;
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return extensions.count("GL_EXT_texture_compression_s3tc") > 0;
+    case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        return extensions.count("GL_EXT_texture_compression_s3tc") > 0 &&
+               (extensions.count("GL_EXT_texture_sRGB") > 0 || extensions.count("GL_EXT_texture_compression_s3tc_srgb") > 0);
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+    {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        return major > 4 || (major == 4 && minor >= 2) || extensions.count("GL_ARB_texture_compression_bptc") > 0;
+    }
+    default:
+        return false;
+    }
+}
+
+// uploads the first levelCount levels of a baked texture to target of the bound texture (GL_TEXTURE_2D or a cube map
+// face); gamma stores color in the sRGB variant of its format
+// ------------------------------------------------------------------------
+inline void UploadKtxLevels(GLenum target, const KtxTexture &texture, int levelCount, bool gamma = false)
+{
+    GLenum internalFormat = gamma ? CompressedSrgbFormat(texture.internalFormat) : texture.internalFormat;
+    for (int level = 0; level < levelCount && level < (int)texture.levels.size(); level++)
+        glCompressedTexImage2D(target, level, internalFormat, texture.levelWidth(level), texture.levelHeight(level), 0,
+                               (GLsizei)texture.levels[level].size, texture.levelData(level));
+}
+
+// creates a 2D texture with all levels of a baked texture, in the sRGB variant of its format if gamma is set; 0 if the
+// GPU can't sample that format
+// ------------------------------------------------------------------------
+inline unsigned int TextureFromKtx(const KtxTexture &texture, GLint wrap, bool gamma = false)
+{
+    if (!texture.valid() || !CompressedFormatSupported(gamma ? CompressedSrgbFormat(texture.internalFormat) : texture.internalFormat))
+        return 0;
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    UploadKtxLevels(GL_TEXTURE_2D, texture, (int)texture.levels.size(), gamma);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1); // in case the chain stops early
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
+#endif
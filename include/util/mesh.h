@@ -6,9 +6,19 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <util/arena.h>
+#include <util/frustum.h>
+#include <util/meshlet.h>
 #include <util/shader.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -26,13 +36,257 @@ struct Vertex
     glm::vec3 Bitangent;
 };
 
+// the layout of the vertex buffer of a mesh, see Mesh::chooseLayout(). The compact layouts keep the attribute
+// locations, but normal and tangent are normalized 10:10:10:2 integers and the bitangent (location 4) is dropped:
+// tangent.w holds its sign, so shaders reconstruct it as cross(normal, tangent.xyz) * sign(tangent.w): under the
+// signed normalized conversion of GL 3.3 a 2 bit w of -1 reads as -1/3, not -1.
+enum class VertexLayout
+{
+    Float,          // Vertex as is, 56 bytes
+    Packed,         // float position, 10:10:10:2 normal and tangent, half float texture coordinates: 24 bytes
+    PackedQuantized // as Packed, but the position is 16 bit unorm relative to the bounds of the mesh: 20 bytes
+};
+
+struct PackedVertex
+{
+    float position[3];
+    std::uint32_t normal;
+    std::uint32_t tangent;
+    std::uint16_t texCoords[2];
+};
+
+struct QuantizedVertex
+{
+    std::uint16_t position[4]; // w is padding, keeps the following attributes 4 byte aligned
+    std::uint32_t normal;
+    std::uint32_t tangent;
+    std::uint16_t texCoords[2];
+};
+
+// a level of detail of a mesh: a range of its index buffer and the error of the simplification in object space
+struct MeshLod
+{
+    std::uint32_t firstIndex;
+    std::uint32_t indexCount;
+    float error;
+};
+
+// a 2D texture, or a layer of a texture array shared with other textures; shaders sample a layer from a
+// sampler2DArray <sampler> at the layer in the int uniform <sampler>Layer, e.g. texture_diffuse1Layer
 struct Texture
 {
     unsigned int id;
     string type;
     string path;
+    GLenum target = GL_TEXTURE_2D; // or GL_TEXTURE_2D_ARRAY
+    int layer = 0;
+};
+
+// bytes per vertex of a layout
+size_t VertexSize(VertexLayout layout)
+{
+    switch (layout)
+    {
+    case VertexLayout::Packed:
+        return sizeof(PackedVertex);
+    case VertexLayout::PackedQuantized:
+        return sizeof(QuantizedVertex);
+    default:
+        return sizeof(Vertex);
+    }
+}
+
+// sets the attribute pointers of a vertex layout for the bound vertex array and array buffer
+// ------------------------------------------------------------------------
+void SetupVertexAttributes(VertexLayout layout)
+{
+    if (layout == VertexLayout::Float)
+    {
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TexCoords));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Tangent));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Bitangent));
+        return;
+    }
+
+    bool quantized = layout == VertexLayout::PackedQuantized;
+    GLsizei stride = (GLsizei)VertexSize(layout);
+    // vertex Positions, normalized to [0, 1] when quantized
+    glEnableVertexAttribArray(0);
+    if (quantized)
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void *)offsetof(QuantizedVertex, position));
+    else
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(PackedVertex, position));
+    size_t normalOffset = quantized ? offsetof(QuantizedVertex, normal) : offsetof(PackedVertex, normal);
+    size_t tangentOffset = quantized ? offsetof(QuantizedVertex, tangent) : offsetof(PackedVertex, tangent);
+    size_t texCoordOffset = quantized ? offsetof(QuantizedVertex, texCoords) : offsetof(PackedVertex, texCoords);
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void *)normalOffset);
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void *)texCoordOffset);
+    // vertex tangent, w is the sign of the bitangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void *)tangentOffset);
+    // no bitangent
+    glDisableVertexAttribArray(4);
+}
+
+// The vertex and index buffers of all meshes. Every vertex layout has its own BufferArena, aligned to the vertex size
+// so that the offset of a mesh is its base vertex, and one vertex array object shared by all meshes of that layout;
+// the indices of all meshes share one arena. Meshes of one layout can thus be drawn together by one
+// glMultiDrawElementsBaseVertex without any rebinding. Use GetMeshArena() instead of creating another one.
+class MeshArena
+{
+public:
+    // the pieces of the arenas that belong to one mesh; move only, so a piece is never freed twice. A move assignment
+    // swaps, which leaves the old pieces with the source to be freed by its owner.
+    struct Allocation
+    {
+        VertexLayout layout = VertexLayout::Float;
+        BufferArena::Handle vertices = BufferArena::INVALID;
+        BufferArena::Handle indices = BufferArena::INVALID;
+
+        Allocation() = default;
+        Allocation(const Allocation &) = delete;
+        Allocation &operator=(const Allocation &) = delete;
+        Allocation(Allocation &&other) noexcept : layout(other.layout), vertices(other.vertices), indices(other.indices)
+        {
+            other.vertices = other.indices = BufferArena::INVALID;
+        }
+        Allocation &operator=(Allocation &&other) noexcept
+        {
+            std::swap(layout, other.layout);
+            std::swap(vertices, other.vertices);
+            std::swap(indices, other.indices);
+            return *this;
+        }
+    };
+
+    // arenas with more free space outside their largest free range are compacted by compactFragmented()
+    static constexpr float MAX_FRAGMENTATION = 0.5f;
+
+    MeshArena() : indexArena(INITIAL_INDEX_BYTES, sizeof(unsigned int))
+    {
+        for (int i = 0; i < LAYOUT_COUNT; i++)
+        {
+            GLsizeiptr stride = (GLsizeiptr)VertexSize((VertexLayout)i);
+            vertexArenas[i].reset(new BufferArena(INITIAL_VERTEX_BYTES / stride * stride, stride));
+            glGenVertexArrays(1, &vertexArrays[i]);
+        }
+        updateVertexArrays();
+    }
+
+    ~MeshArena() { glDeleteVertexArrays(LAYOUT_COUNT, vertexArrays); }
+
+    MeshArena(const MeshArena &) = delete;
+    MeshArena &operator=(const MeshArena &) = delete;
+
+    // uploads the vertices (already in the given layout) and indices of a mesh
+    // ------------------------------------------------------------------------
+    Allocation allocate(VertexLayout layout, const void *vertexData, size_t vertexBytes, const void *indexData, size_t indexBytes)
+    {
+        Allocation allocation;
+        allocation.layout = layout;
+        allocation.vertices = vertexArenas[(int)layout]->allocate((GLsizeiptr)vertexBytes, vertexData);
+        allocation.indices = indexArena.allocate((GLsizeiptr)indexBytes, indexData);
+        updateVertexArrays();
+        return allocation;
+    }
+
+    void free(Allocation &allocation)
+    {
+        if (allocation.vertices != BufferArena::INVALID)
+            vertexArenas[(int)allocation.layout]->free(allocation.vertices);
+        if (allocation.indices != BufferArena::INVALID)
+            indexArena.free(allocation.indices);
+        allocation = Allocation();
+    }
+
+    GLint baseVertex(const Allocation &allocation) const
+    {
+        const BufferArena &arena = *vertexArenas[(int)allocation.layout];
+        return (GLint)(arena.offset(allocation.vertices) / arena.getAlignment());
+    }
+
+    // in bytes, add it to the offsets passed to the draw calls
+    std::uintptr_t indexOffset(const Allocation &allocation) const { return (std::uintptr_t)indexArena.offset(allocation.indices); }
+
+    GLuint vertexArray(VertexLayout layout) const { return vertexArrays[(int)layout]; }
+
+    BufferArena::Stats vertexStats(VertexLayout layout) const { return vertexArenas[(int)layout]->getStats(); }
+    BufferArena::Stats indexStats() const { return indexArena.getStats(); }
+
+    // moves the meshes of every arena together; offsets change, so it must not run between building and issuing a draw
+    // ------------------------------------------------------------------------
+    void compact()
+    {
+        for (int i = 0; i < LAYOUT_COUNT; i++)
+            vertexArenas[i]->compact();
+        indexArena.compact();
+        updateVertexArrays();
+    }
+
+    // compacts only the arenas above MAX_FRAGMENTATION, cheap enough to call once per frame
+    void compactFragmented()
+    {
+        for (int i = 0; i < LAYOUT_COUNT; i++)
+            if (vertexArenas[i]->getStats().fragmentation() > MAX_FRAGMENTATION)
+                vertexArenas[i]->compact();
+        if (indexArena.getStats().fragmentation() > MAX_FRAGMENTATION)
+            indexArena.compact();
+        updateVertexArrays();
+    }
+
+private:
+    static constexpr int LAYOUT_COUNT = 3;
+    static constexpr GLsizeiptr INITIAL_VERTEX_BYTES = 4 << 20;
+    static constexpr GLsizeiptr INITIAL_INDEX_BYTES = 2 << 20;
+
+    std::unique_ptr<BufferArena> vertexArenas[LAYOUT_COUNT];
+    BufferArena indexArena;
+    GLuint vertexArrays[LAYOUT_COUNT];
+    unsigned int vertexGenerations[LAYOUT_COUNT] = {};
+    unsigned int indexGenerations[LAYOUT_COUNT] = {};
+
+    // points the vertex arrays to the buffers again after an arena replaced its buffer
+    void updateVertexArrays()
+    {
+        for (int i = 0; i < LAYOUT_COUNT; i++)
+        {
+            if (vertexGenerations[i] == vertexArenas[i]->getGeneration() && indexGenerations[i] == indexArena.getGeneration())
+                continue;
+            glBindVertexArray(vertexArrays[i]);
+            glBindBuffer(GL_ARRAY_BUFFER, vertexArenas[i]->getBuffer());
+            SetupVertexAttributes((VertexLayout)i);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexArena.getBuffer());
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            vertexGenerations[i] = vertexArenas[i]->getGeneration();
+            indexGenerations[i] = indexArena.getGeneration();
+        }
+    }
 };
 
+// never destroyed: meshes in static storage may outlive a static arena, and the GL context is gone at exit anyway
+MeshArena &GetMeshArena()
+{
+    static MeshArena *arena = new MeshArena();
+    return *arena;
+}
+
 class Mesh
 {
 public:
@@ -40,30 +294,277 @@ public:
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
-    unsigned int VAO;
+    unsigned int VAO; // shared by all meshes of the same layout, see MeshArena
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT if all vertices can be addressed with 16 bits
+    VertexLayout layout = VertexLayout::Float;
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f); // axis aligned bounding box
+    vector<Meshlet> meshlets; // clusters for DrawCulled(), empty for meshes that are always drawn as a whole
+    vector<MeshLod> lods;     // levels of detail from fine to coarse, all in one index buffer; empty for a single level
 
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, VertexLayout layout = VertexLayout::Float)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->layout = layout;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+
+        if (!this->vertices.empty())
+            boundsMin = boundsMax = this->vertices[0].Position;
+        for (const Vertex &vertex : this->vertices)
+        {
+            boundsMin = glm::min(boundsMin, vertex.Position);
+            boundsMax = glm::max(boundsMax, vertex.Position);
+        }
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+        setupSamplerNames();
+    }
+
+    // constructor for data that is owned elsewhere, e.g. a memory mapped model cache: the data is uploaded
+    // straight from there and no CPU copy is kept, so vertices and indices stay empty
+    Mesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount,
+         const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, vector<Texture> textures, VertexLayout layout = VertexLayout::Float)
+    {
+        this->layout = layout;
+        this->textures = std::move(textures);
+        this->boundsMin = boundsMin;
+        this->boundsMax = boundsMax;
+        setupMesh(vertexData, vertexCount, indexData, indexCount);
+        setupSamplerNames();
+    }
+
+    // a mesh owns its part of the MeshArena, so it can be moved but not copied
+    Mesh(Mesh &&) = default;
+    Mesh &operator=(Mesh &&) = default;
+    ~Mesh() { release(); }
+
+    // render the mesh, at the given level of detail
+    void Draw(Shader &shader, int lod = 0)
+    {
+        if (!setPositionUniforms(shader))
+            return;
+        bindTextures(shader);
+
+        // draw mesh
+        MeshLod level = getLod(lod);
+        glBindVertexArray(VAO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)level.indexCount, indexType, indexPointer(level.firstIndex), baseVertex());
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // render the meshlets that are inside the frustum and not facing away from the camera; frustum and camera
+    // position are in the space of the mesh (e.g. Frustum(projection * view * model)). Without meshlets it's Draw().
+    void DrawCulled(Shader &shader, const Frustum &frustum, const glm::vec3 &camera, MeshletStats &stats)
+    {
+        if (meshlets.empty())
+        {
+            Draw(shader);
+            return;
+        }
+
+        // surviving neighbors are merged into one index range
+        drawCounts.clear();
+        drawOffsets.clear();
+        drawBaseVertices.clear();
+        std::uint32_t rangeEnd = 0;
+        for (const Meshlet &meshlet : meshlets)
+        {
+            stats.tested++;
+            if (frustum.testSphere(meshlet.center, meshlet.radius) == Frustum::OUTSIDE)
+            {
+                stats.outsideFrustum++;
+                continue;
+            }
+            if (meshlet.isBackFacing(camera))
+            {
+                stats.backFacing++;
+                continue;
+            }
+            stats.drawn++;
+            if (!drawCounts.empty() && meshlet.firstIndex == rangeEnd)
+                drawCounts.back() += (GLsizei)meshlet.indexCount;
+            else
+            {
+                drawCounts.push_back((GLsizei)meshlet.indexCount);
+                drawOffsets.push_back(indexPointer(meshlet.firstIndex));
+                drawBaseVertices.push_back(baseVertex());
+            }
+            rangeEnd = meshlet.firstIndex + meshlet.indexCount;
+        }
+        if (drawCounts.empty() || !setPositionUniforms(shader))
+            return;
+        stats.ranges += drawCounts.size();
+
+        bindTextures(shader);
+        glBindVertexArray(VAO);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(), (GLsizei)drawCounts.size(), drawBaseVertices.data());
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    int lodCount() const { return lods.empty() ? 1 : (int)lods.size(); }
+
+    // the index range of a level of detail, levels beyond the coarsest one give the coarsest one
+    MeshLod getLod(int lod) const
+    {
+        if (lods.empty())
+            return {0, indexCount, 0.0f};
+        return lods[std::min(std::max(lod, 0), (int)lods.size() - 1)];
     }
 
-    // render the mesh
-    void Draw(Shader shader)
+    // the coarsest level whose error covers at most maxPixels on screen, with pixelsPerUnit the size of one object
+    // space unit on screen at the distance of the mesh
+    int selectLod(float pixelsPerUnit, float maxPixels) const
+    {
+        for (int lod = (int)lods.size() - 1; lod > 0; lod--)
+            if (lods[lod].error * pixelsPerUnit <= maxPixels)
+                return lod;
+        return 0;
+    }
+
+    size_t indexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(unsigned int); }
+
+    // where the buffers of the mesh are in the shared ones of the MeshArena; both change when the arena is compacted
+    GLint baseVertex() const { return GetMeshArena().baseVertex(allocation); }
+    // the offset of an index of this mesh for the draw calls, in bytes from the start of the shared index buffer
+    const void *indexPointer(std::uint32_t firstIndex) const
+    {
+        return (const void *)(GetMeshArena().indexOffset(allocation) + firstIndex * indexSize());
+    }
+
+    // returns the buffers to the MeshArena early; the mesh must not be drawn afterwards
+    void release() { GetMeshArena().free(allocation); }
+
+    // drops the CPU copies of vertices and indices, which aren't needed for drawing; returns the bytes freed
+    size_t releaseCpuData()
+    {
+        size_t bytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+        return bytes;
+    }
+
+    // size of the vertex buffer on the GPU
+    size_t vertexBytes() const { return (size_t)vertexCount * vertexSize(layout); }
+
+    // maps the quantized positions of PackedQuantized back to object space, the vertex shader takes
+    // aPos * positionScale() + positionOffset(); scale 1 and offset 0 for the other layouts
+    glm::vec3 positionScale() const { return layout == VertexLayout::PackedQuantized ? boundsMax - boundsMin : glm::vec3(1.0f); }
+    glm::vec3 positionOffset() const { return layout == VertexLayout::PackedQuantized ? boundsMin : glm::vec3(0.0f); }
+
+    // the plain uniforms of direct draws; the RenderQueue passes them in DrawUniforms instead
+    static constexpr UniformId POSITION_SCALE_UNIFORM = UniformId("positionScale");
+    static constexpr UniformId POSITION_OFFSET_UNIFORM = UniformId("positionOffset");
+
+    // sets the position uniforms for a direct draw. A shader without them can't draw a quantized mesh, whose
+    // positions would stay in [0, 1]: then it returns false and the mesh is skipped, which is reported once.
+    bool setPositionUniforms(Shader &shader)
+    {
+        if (shader.getUniformLocation(POSITION_SCALE_UNIFORM) == -1)
+        {
+            if (layout != VertexLayout::PackedQuantized)
+                return true;
+            if (!reportedUnscaled)
+                std::cout << "ERROR::MESH : a quantized mesh needs a positionScale and positionOffset uniform in shader " << shader.ID
+                          << ", it is not drawn" << std::endl;
+            reportedUnscaled = true;
+            return false;
+        }
+        shader.setVec3(POSITION_SCALE_UNIFORM, positionScale());
+        shader.setVec3(POSITION_OFFSET_UNIFORM, positionOffset());
+        return true;
+    }
+
+    static size_t vertexSize(VertexLayout layout) { return VertexSize(layout); }
+
+    // picks the smallest layout that keeps the mesh intact: texture coordinates only fit half floats with enough
+    // precision close to [0, 1], positions are only quantized if the 16 bit steps stay below positionTolerance
+    // ------------------------------------------------------------------------
+    static VertexLayout chooseLayout(const Vertex *vertexData, size_t vertexCount, float positionTolerance)
+    {
+        if (vertexCount == 0)
+            return VertexLayout::Float;
+        glm::vec3 low = vertexData[0].Position, high = vertexData[0].Position;
+        float texCoordRange = 0.0f;
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            low = glm::min(low, vertexData[i].Position);
+            high = glm::max(high, vertexData[i].Position);
+            texCoordRange = std::max(texCoordRange, std::max(std::abs(vertexData[i].TexCoords.x), std::abs(vertexData[i].TexCoords.y)));
+        }
+        if (texCoordRange > 2.0f) // beyond 2 half floats are coarser than 1/1024, e.g. for tiled textures
+            return VertexLayout::Float;
+        glm::vec3 extent = high - low;
+        float largest = std::max(extent.x, std::max(extent.y, extent.z));
+        return largest / 65535.0f * 0.5f <= positionTolerance ? VertexLayout::PackedQuantized : VertexLayout::Packed;
+    }
+
+    // sampler uniform per texture, in the order of textures
+    const vector<UniformId> &getSamplerNames() const { return samplerNames; }
+    // layer uniform per texture, only set for layers of texture arrays
+    const vector<UniformId> &getLayerNames() const { return layerNames; }
+
+    // binds the textures to the units 0, 1, ... and points the samplers of the shader there
+    void bindTextures(Shader &shader) const
     {
         // bind appropriate textures
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+            // now set the sampler to the correct texture unit (skipped by the shader if it already is)
+            shader.setInt(samplerNames[i], i);
+            // and finally bind the texture
+            glBindTexture(textures[i].target, textures[i].id);
+        }
+        setTextureLayers(shader);
+    }
+
+    // points the shader to the layers of the texture arrays; enough to switch from a mesh whose textures are bound
+    // to the same units, see sameTextureBindings()
+    void setTextureLayers(Shader &shader) const
+    {
+        for (unsigned int i = 0; i < textures.size(); i++)
+            if (textures[i].target == GL_TEXTURE_2D_ARRAY)
+                shader.setInt(layerNames[i], textures[i].layer);
+    }
+
+    // true if the textures of both meshes are bound the same way, they may still use different layers
+    bool sameTextureBindings(const Mesh &other) const
+    {
+        if (textures.size() != other.textures.size())
+            return false;
+        for (size_t i = 0; i < textures.size(); i++)
+            if (textures[i].id != other.textures[i].id || samplerNames[i].hash != other.samplerNames[i].hash)
+                return false;
+        return true;
+    }
+
+private:
+    // render data
+    MeshArena::Allocation allocation;
+    vector<UniformId> samplerNames; // sampler uniform per texture, e.g. texture_diffuse1
+    vector<UniformId> layerNames;   // e.g. texture_diffuse1Layer
+    vector<GLsizei> drawCounts;      // index ranges of DrawCulled(), kept to avoid allocations
+    vector<const void *> drawOffsets;
+    vector<GLint> drawBaseVertices;
+    bool reportedUnscaled = false; // see setPositionUniforms()
+
+    // names the samplers once instead of building the strings on every draw
+    void setupSamplerNames()
+    {
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr = 1;
         unsigned int heightNr = 1;
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -75,63 +576,113 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if (name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            samplerNames.push_back(UniformId(name + number));
+            layerNames.push_back(UniformId(name + number + "Layer"));
         }
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    // uploads the vertices and indices into the shared buffers of the MeshArena
+    void setupMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount)
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        this->vertexCount = (unsigned int)vertexCount;
+        this->indexCount = (unsigned int)indexCount;
 
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        std::vector<char> packed;
+        const void *vertexBytes = vertexData;
+        if (layout != VertexLayout::Float)
+        {
+            packed = packVertices(vertexData, vertexCount);
+            vertexBytes = packed.data();
+        }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        // 16 bit indices when the mesh is small enough; the base vertex keeps them relative to the mesh
+        std::vector<std::uint16_t> shortIndices;
+        const void *indexBytes = indexData;
+        indexType = GL_UNSIGNED_INT;
+        if (vertexCount <= 65536)
+        {
+            indexType = GL_UNSIGNED_SHORT;
+            shortIndices.assign(indexData, indexData + indexCount);
+            indexBytes = shortIndices.data();
+        }
 
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Bitangent));
+        MeshArena &arena = GetMeshArena();
+        allocation = arena.allocate(layout, vertexBytes, vertexCount * vertexSize(layout), indexBytes, indexCount * indexSize());
+        VAO = arena.vertexArray(layout);
+    }
 
-        glBindVertexArray(0);
+    // converts the vertices into one of the compact layouts
+    std::vector<char> packVertices(const Vertex *vertexData, size_t vertexCount) const
+    {
+        bool quantized = layout == VertexLayout::PackedQuantized;
+        size_t stride = vertexSize(layout);
+        std::vector<char> packed(vertexCount * stride);
+        glm::vec3 extent = boundsMax - boundsMin;
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            const Vertex &vertex = vertexData[i];
+            // the handedness of the tangent frame, so the bitangent can be rebuilt in the shader
+            float sign = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            std::uint32_t normal = packSnorm1010102(vertex.Normal, 0.0f);
+            std::uint32_t tangent = packSnorm1010102(vertex.Tangent, sign);
+            std::uint16_t texCoords[2] = {packHalf(vertex.TexCoords.x), packHalf(vertex.TexCoords.y)};
+            char *target = &packed[i * stride];
+            if (quantized)
+            {
+                QuantizedVertex &v = *(QuantizedVertex *)target;
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    float t = extent[axis] > 0.0f ? (vertex.Position[axis] - boundsMin[axis]) / extent[axis] : 0.0f;
+                    v.position[axis] = (std::uint16_t)std::lround(std::min(std::max(t, 0.0f), 1.0f) * 65535.0f);
+                }
+                v.position[3] = 0;
+                v.normal = normal;
+                v.tangent = tangent;
+                std::memcpy(v.texCoords, texCoords, sizeof(texCoords));
+            }
+            else
+            {
+                PackedVertex &v = *(PackedVertex *)target;
+                for (int axis = 0; axis < 3; axis++)
+                    v.position[axis] = vertex.Position[axis];
+                v.normal = normal;
+                v.tangent = tangent;
+                std::memcpy(v.texCoords, texCoords, sizeof(texCoords));
+            }
+        }
+        return packed;
+    }
+
+    // x, y, z as 10 bit and w as 2 bit signed normalized integers, in the order of GL_INT_2_10_10_10_REV
+    static std::uint32_t packSnorm1010102(const glm::vec3 &v, float w)
+    {
+        auto component = [](float value, float scale, std::uint32_t mask)
+        {
+            long packed = std::lround(std::min(std::max(value, -1.0f), 1.0f) * scale);
+            return (std::uint32_t)packed & mask;
+        };
+        return component(v.x, 511.0f, 0x3ff) | (component(v.y, 511.0f, 0x3ff) << 10) |
+               (component(v.z, 511.0f, 0x3ff) << 20) | (component(w, 1.0f, 0x3) << 30);
+    }
+
+    // IEEE half float, rounded to nearest; tiny values flush to zero
+    static std::uint16_t packHalf(float value)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        std::uint16_t sign = (std::uint16_t)((bits >> 16) & 0x8000);
+        int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+        std::uint32_t mantissa = bits & 0x7fffff;
+        if (exponent <= 0)
+            return sign;
+        if (exponent >= 31)
+            return (std::uint16_t)(sign | 0x7c00);
+        std::uint32_t half = ((std::uint32_t)exponent << 10) | (mantissa >> 13);
+        half += (mantissa >> 12) & 1; // a carry into the exponent is still the right result
+        return (std::uint16_t)(sign | std::min(half, 0x7c00u));
     }
 };
 #endif
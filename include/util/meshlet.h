@@ -0,0 +1,116 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// A cluster of consecutive triangles of a mesh with bounds for culling. Meshlets are ranges of the index buffer, so
+// the triangles that survive culling are drawn with one glMultiDrawElements call and without any extra index data.
+struct Meshlet
+{
+    std::uint32_t firstIndex;
+    std::uint32_t indexCount;
+    glm::vec3 center; // bounding sphere
+    float radius;
+    glm::vec3 coneAxis; // the normals of all triangles lie within coneCutoff of the axis, see isBackFacing()
+    float coneCutoff;   // 1 if the normals spread too far for the cluster to ever face away completely
+
+    // true if the camera (in the same space) only sees the back of every triangle of the cluster
+    bool isBackFacing(const glm::vec3 &camera) const
+    {
+        glm::vec3 toCenter = center - camera;
+        return glm::dot(toCenter, coneAxis) >= coneCutoff * glm::length(toCenter) + radius;
+    }
+};
+
+// splits an index buffer into meshlets of at most maxVertices vertices and maxTriangles triangles; the triangles are
+// taken in their order, so the index buffer should be cache optimized first (see MeshOptimizer)
+// ------------------------------------------------------------------------
+template <class VertexType>
+std::vector<Meshlet> BuildMeshlets(const VertexType *vertices, const unsigned int *indices, size_t indexCount,
+                                   size_t maxVertices = 64, size_t maxTriangles = 124)
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<unsigned int> used; // vertices of the current meshlet
+    size_t first = 0;
+
+    auto finish = [&](size_t end)
+    {
+        Meshlet meshlet;
+        meshlet.firstIndex = (std::uint32_t)first;
+        meshlet.indexCount = (std::uint32_t)(end - first);
+
+        // sphere around the center of the bounding box
+        glm::vec3 low = vertices[indices[first]].Position, high = low;
+        for (size_t i = first; i < end; i++)
+        {
+            low = glm::min(low, vertices[indices[i]].Position);
+            high = glm::max(high, vertices[indices[i]].Position);
+        }
+        meshlet.center = (low + high) * 0.5f;
+        meshlet.radius = 0.0f;
+        for (size_t i = first; i < end; i++)
+            meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+
+        // normal cone: the average of the face normals and the widest angle to it
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis(0.0f);
+        for (size_t i = first; i + 2 < end; i += 3)
+        {
+            const glm::vec3 &a = vertices[indices[i]].Position;
+            glm::vec3 n = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+            float length = glm::length(n);
+            if (length <= 0.0f)
+                continue; // degenerate triangles are never visible
+            normals.push_back(n / length);
+            axis += normals.back();
+        }
+        meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.coneCutoff = 1.0f;
+        float axisLength = glm::length(axis);
+        if (axisLength > 0.0f)
+        {
+            meshlet.coneAxis = axis / axisLength;
+            float minDot = 1.0f;
+            for (const glm::vec3 &n : normals)
+                minDot = std::min(minDot, glm::dot(n, meshlet.coneAxis));
+            // the sine of the spread is what the back facing test needs; beyond 90 degrees it is never back facing
+            if (minDot > 0.0f)
+                meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+        meshlets.push_back(meshlet);
+        used.clear();
+        first = end;
+    };
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        size_t added = 0;
+        for (int corner = 0; corner < 3; corner++)
+            if (std::find(used.begin(), used.end(), indices[i + corner]) == used.end())
+                added++;
+        if (used.size() + added > maxVertices || (i - first) / 3 + 1 > maxTriangles)
+            finish(i);
+        for (int corner = 0; corner < 3; corner++)
+            if (std::find(used.begin(), used.end(), indices[i + corner]) == used.end())
+                used.push_back(indices[i + corner]);
+    }
+    if (first + 3 <= indexCount)
+        finish(indexCount - indexCount % 3);
+    return meshlets;
+}
+
+// meshlets rejected and drawn by Mesh::DrawCulled(), summed up over the calls
+struct MeshletStats
+{
+    size_t tested = 0;
+    size_t outsideFrustum = 0;
+    size_t backFacing = 0;
+    size_t drawn = 0;
+    size_t ranges = 0; // index ranges passed to glMultiDrawElements, neighboring meshlets are merged
+};
+#endif
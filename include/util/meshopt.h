@@ -0,0 +1,376 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <glm/glm.hpp>
+
+#include <util/mesh.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+// how well a mesh uses the GPU, before and after MeshOptimizer::optimize()
+struct MeshOptimizationStats
+{
+    size_t triangles = 0;
+    size_t verticesBefore = 0, verticesAfter = 0;
+    float acmrBefore = 0.0f, acmrAfter = 0.0f;         // vertex shader runs per triangle, 0.5 is the ideal for a grid
+    float overdrawBefore = 0.0f, overdrawAfter = 0.0f; // shaded fragments per covered pixel, 1 is no overdraw
+};
+
+// Reorders a triangle mesh for the GPU once at import:
+//   1. identical vertices are welded
+//   2. triangles are reordered for the post-transform vertex cache (Tipsify, Sander et al. 2007)
+//   3. the resulting clusters of triangles are sorted so that outward facing parts come first, which lowers overdraw,
+//      as long as the cache efficiency drops by less than OVERDRAW_THRESHOLD
+//   4. vertices are reordered by their first use, so the vertex fetch reads the buffer sequentially
+// Everything is CPU only, so meshes may be optimized on worker threads.
+class MeshOptimizer
+{
+public:
+    static constexpr int CACHE_SIZE = 16;                 // FIFO entries of the simulated post-transform cache
+    static constexpr float OVERDRAW_THRESHOLD = 1.05f;    // largest ACMR increase accepted for less overdraw
+    static constexpr int OVERDRAW_RESOLUTION = 64;        // size of the views the overdraw is measured in
+
+    // optimizes the mesh in place and returns the statistics
+    // ------------------------------------------------------------------------
+    static MeshOptimizationStats optimize(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+    {
+        MeshOptimizationStats stats;
+        stats.triangles = indices.size() / 3;
+        stats.verticesBefore = vertices.size();
+        stats.acmrBefore = acmr(indices, vertices.size());
+        stats.overdrawBefore = overdraw(vertices, indices);
+
+        weld(vertices, indices);
+        optimizeVertexCache(indices, vertices.size());
+        optimizeOverdraw(vertices, indices);
+        optimizeVertexFetch(vertices, indices);
+
+        stats.verticesAfter = vertices.size();
+        stats.acmrAfter = acmr(indices, vertices.size());
+        stats.overdrawAfter = overdraw(vertices, indices);
+        return stats;
+    }
+
+    // merges vertices whose attributes are bit for bit identical
+    // ------------------------------------------------------------------------
+    static void weld(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+    {
+        struct Hash
+        {
+            size_t operator()(const Vertex *v) const
+            {
+                const unsigned char *bytes = (const unsigned char *)v;
+                std::uint64_t hash = 14695981039346656037ull;
+                for (size_t i = 0; i < sizeof(Vertex); i++)
+                    hash = (hash ^ bytes[i]) * 1099511628211ull;
+                return (size_t)hash;
+            }
+        };
+        struct Equal
+        {
+            bool operator()(const Vertex *a, const Vertex *b) const { return std::memcmp(a, b, sizeof(Vertex)) == 0; }
+        };
+        // Vertex is only floats, so it has no padding that could hold garbage
+        std::unordered_map<const Vertex *, unsigned int, Hash, Equal> unique(vertices.size());
+        std::vector<unsigned int> remap(vertices.size());
+        std::vector<Vertex> welded;
+        welded.reserve(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            auto it = unique.emplace(&vertices[i], (unsigned int)welded.size());
+            if (it.second)
+                welded.push_back(vertices[i]);
+            remap[i] = it.first->second;
+        }
+        for (unsigned int &index : indices)
+            index = remap[index];
+        vertices.swap(welded);
+    }
+
+    // Tipsify: fans around vertices that are still in the cache, falls back to recently used vertices at dead ends
+    // ------------------------------------------------------------------------
+    static void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        // triangles per vertex, as offsets into one array
+        std::vector<unsigned int> live(vertexCount, 0), offsets(vertexCount + 1, 0), adjacency(indices.size());
+        for (unsigned int index : indices)
+            live[index]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + live[v];
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+        std::vector<unsigned int> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<unsigned int> deadEnds, candidates, result;
+        result.reserve(indices.size());
+        unsigned int time = CACHE_SIZE + 1;
+        size_t cursor = 0; // next vertex to try when the dead end stack is empty
+        long fan = indices[0];
+        while (fan >= 0)
+        {
+            candidates.clear();
+            for (unsigned int a = offsets[fan]; a < offsets[fan + 1]; a++)
+            {
+                unsigned int triangle = adjacency[a];
+                if (emitted[triangle])
+                    continue;
+                emitted[triangle] = true;
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    unsigned int v = indices[triangle * 3 + corner];
+                    result.push_back(v);
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - cacheTime[v] > (unsigned int)CACHE_SIZE)
+                        cacheTime[v] = time++;
+                }
+            }
+
+            // the candidate that stays in the cache the longest, unless fanning it would push it out
+            fan = -1;
+            int best = -1;
+            for (unsigned int v : candidates)
+            {
+                if (live[v] == 0)
+                    continue;
+                int priority = 0;
+                if (time - cacheTime[v] + 2 * live[v] <= (unsigned int)CACHE_SIZE)
+                    priority = (int)(time - cacheTime[v]);
+                if (priority > best)
+                {
+                    best = priority;
+                    fan = v;
+                }
+            }
+            if (fan >= 0)
+                continue;
+            while (!deadEnds.empty() && fan < 0)
+            {
+                unsigned int v = deadEnds.back();
+                deadEnds.pop_back();
+                if (live[v] > 0)
+                    fan = v;
+            }
+            for (; cursor < vertexCount && fan < 0; cursor++)
+                if (live[cursor] > 0)
+                    fan = (long)cursor;
+        }
+        indices.swap(result);
+    }
+
+    // sorts the clusters of a cache optimized index buffer: clusters start where the cache is cold, i.e. at
+    // triangles whose three vertices all miss. Clusters facing away from the center are drawn first.
+    // ------------------------------------------------------------------------
+    static void optimizeOverdraw(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2)
+            return;
+
+        std::vector<size_t> clusterStarts;
+        {
+            Cache cache(vertices.size());
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                int misses = 0;
+                for (int corner = 0; corner < 3; corner++)
+                    misses += cache.access(indices[t * 3 + corner]) ? 0 : 1;
+                if (misses == 3 || t == 0)
+                    clusterStarts.push_back(t);
+            }
+        }
+        if (clusterStarts.size() < 2)
+            return;
+        clusterStarts.push_back(triangleCount);
+
+        // area weighted centroid of the mesh, and per cluster its centroid and summed normal
+        glm::vec3 meshCenter(0.0f);
+        float meshArea = 0.0f;
+        struct Cluster
+        {
+            size_t begin, end;
+            float sortKey;
+        };
+        std::vector<Cluster> clusters;
+        std::vector<glm::vec3> centers, normals;
+        for (size_t c = 0; c + 1 < clusterStarts.size(); c++)
+        {
+            glm::vec3 center(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+            {
+                const glm::vec3 &a = vertices[indices[t * 3]].Position;
+                const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3 &d = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 n = glm::cross(b - a, d - a);
+                float triangleArea = glm::length(n);
+                center += (a + b + d) * (triangleArea / 3.0f);
+                normal += n;
+                area += triangleArea;
+            }
+            meshCenter += center;
+            meshArea += area;
+            centers.push_back(area > 0.0f ? center / area : center);
+            normals.push_back(normal);
+            clusters.push_back({clusterStarts[c], clusterStarts[c + 1], 0.0f});
+        }
+        if (meshArea > 0.0f)
+            meshCenter /= meshArea;
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            float length = glm::length(normals[c]);
+            clusters[c].sortKey = length > 0.0f ? glm::dot(centers[c] - meshCenter, normals[c] / length) : 0.0f;
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b)
+                         { return a.sortKey > b.sortKey; });
+
+        std::vector<unsigned int> sorted;
+        sorted.reserve(indices.size());
+        for (const Cluster &cluster : clusters)
+            sorted.insert(sorted.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+        // sorting may join clusters badly; keep the cache order if it costs too much
+        if (acmr(sorted, vertices.size()) <= acmr(indices, vertices.size()) * OVERDRAW_THRESHOLD)
+            indices.swap(sorted);
+    }
+
+    // renumbers the vertices in the order of their first use and drops unused ones
+    // ------------------------------------------------------------------------
+    static void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+    {
+        const unsigned int unused = std::numeric_limits<unsigned int>::max();
+        std::vector<unsigned int> remap(vertices.size(), unused);
+        std::vector<Vertex> ordered;
+        ordered.reserve(vertices.size());
+        for (unsigned int &index : indices)
+        {
+            if (remap[index] == unused)
+            {
+                remap[index] = (unsigned int)ordered.size();
+                ordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(ordered);
+    }
+
+    // average cache miss ratio: transformed vertices per triangle with a FIFO cache of CACHE_SIZE entries
+    // ------------------------------------------------------------------------
+    static float acmr(const std::vector<unsigned int> &indices, size_t vertexCount)
+    {
+        if (indices.size() < 3)
+            return 0.0f;
+        Cache cache(vertexCount);
+        size_t misses = 0;
+        for (unsigned int index : indices)
+            misses += cache.access(index) ? 0 : 1;
+        return (float)misses / (float)(indices.size() / 3);
+    }
+
+    // rasterizes the front faces from the six axis directions and returns shaded fragments per covered pixel;
+    // fragments are shaded when they pass a less depth test, like with early depth testing on the GPU
+    // ------------------------------------------------------------------------
+    static float overdraw(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+    {
+        // camera direction, right and up of each view; right x up points towards the camera
+        static const glm::vec3 views[6][3] = {
+            {glm::vec3(0, 0, -1), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0)},
+            {glm::vec3(0, 0, 1), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0)},
+            {glm::vec3(-1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0)},
+            {glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0)},
+            {glm::vec3(0, -1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, -1)},
+            {glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1)},
+        };
+        if (vertices.empty() || indices.size() < 3)
+            return 0.0f;
+
+        const int size = OVERDRAW_RESOLUTION;
+        std::vector<float> depth(size * size);
+        std::vector<glm::vec3> projected(vertices.size());
+        size_t shaded = 0, covered = 0;
+        for (const auto &view : views)
+        {
+            // map the mesh onto the view, keeping the aspect ratio
+            glm::vec2 low(std::numeric_limits<float>::max()), high(-std::numeric_limits<float>::max());
+            for (size_t v = 0; v < vertices.size(); v++)
+            {
+                const glm::vec3 &p = vertices[v].Position;
+                projected[v] = glm::vec3(glm::dot(p, view[1]), glm::dot(p, view[2]), glm::dot(p, view[0]));
+                low = glm::min(low, glm::vec2(projected[v].x, projected[v].y));
+                high = glm::max(high, glm::vec2(projected[v].x, projected[v].y));
+            }
+            float extent = std::max(high.x - low.x, high.y - low.y);
+            float scale = extent > 0.0f ? (size - 1) / extent : 0.0f;
+            for (glm::vec3 &p : projected)
+            {
+                p.x = (p.x - low.x) * scale;
+                p.y = (p.y - low.y) * scale;
+            }
+
+            std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                const glm::vec3 &a = projected[indices[t]], &b = projected[indices[t + 1]], &c = projected[indices[t + 2]];
+                float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+                if (area <= 0.0f) // back facing or degenerate
+                    continue;
+                int x0 = std::max(0, (int)std::ceil(std::min(a.x, std::min(b.x, c.x)) - 0.5f));
+                int x1 = std::min(size - 1, (int)std::floor(std::max(a.x, std::max(b.x, c.x)) - 0.5f));
+                int y0 = std::max(0, (int)std::ceil(std::min(a.y, std::min(b.y, c.y)) - 0.5f));
+                int y1 = std::min(size - 1, (int)std::floor(std::max(a.y, std::max(b.y, c.y)) - 0.5f));
+                for (int y = y0; y <= y1; y++)
+                {
+                    for (int x = x0; x <= x1; x++)
+                    {
+                        float px = x + 0.5f, py = y + 0.5f;
+                        float w0 = (c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x);
+                        float w1 = (a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x);
+                        float w2 = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+                        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                            continue;
+                        float z = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+                        float &stored = depth[y * size + x];
+                        if (z < stored)
+                        {
+                            if (stored == std::numeric_limits<float>::max())
+                                covered++;
+                            stored = z;
+                            shaded++;
+                        }
+                    }
+                }
+            }
+        }
+        return covered > 0 ? (float)shaded / (float)covered : 0.0f;
+    }
+
+private:
+    // FIFO post-transform cache, a vertex is in it if it was one of the last CACHE_SIZE misses
+    struct Cache
+    {
+        std::vector<size_t> missTime;
+        size_t time = CACHE_SIZE + 1;
+
+        explicit Cache(size_t vertexCount) : missTime(vertexCount, 0) {}
+
+        bool access(unsigned int vertex)
+        {
+            if (time - missTime[vertex] <= (size_t)CACHE_SIZE)
+                return true;
+            missTime[vertex] = time++;
+            return false;
+        }
+    };
+};
+#endif
@@ -11,18 +11,51 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <util/camera.h>
+#include <util/ktx.h>
 #include <util/mesh.h>
+#include <util/meshopt.h>
+#include <util/modelcache.h>
+#include <util/renderqueue.h>
+#include <util/resample.h>
 #include <util/shader.h>
+#include <util/simplify.h>
+#include <util/threadpool.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <memory>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <tuple>
 #include <vector>
 using namespace std;
 
+// pixels decoded by stb_image, freed with it; or the blocks of the baked <filename>.ktx, then pixels stays empty.
+// BuildMipLevels() replaces the pixels by a mip chain.
+struct DecodedImage
+{
+    std::unique_ptr<unsigned char, void (*)(void *)> pixels{nullptr, stbi_image_free};
+    int width = 0, height = 0, channels = 0;
+    bool srgb = false; // color in sRGB, its mip levels are averaged in linear light
+    std::vector<ImageResampler::Level> levels; // level 0 first
+    KtxTexture baked;
+};
+
+void FlipRows(unsigned char *pixels, int width, int height, int channels);
+DecodedImage DecodePixels(const string &filename, bool flipped = false, int channels = 0);
+DecodedImage DecodeImage(const string &filename, bool flipped = false, bool srgb = false);
+void BuildMipLevels(DecodedImage &image, bool powerOf2 = false);
+void UploadImageLevels(const DecodedImage &image, bool gamma);
+unsigned int TextureArrayFromImages(const vector<const DecodedImage *> &images, bool gamma = false);
+unsigned int TextureFromImage(DecodedImage &image, const string &filename, bool gamma = false);
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+size_t TextureBytes(unsigned int id, GLenum target = GL_TEXTURE_2D);
 
 class Model 
 {
@@ -33,65 +66,572 @@ public:
     string directory;
     bool gammaCorrection;
     bool loadTexturesFromModel;
+    bool compressVertices;        // pick a compact VertexLayout per mesh, see Mesh::chooseLayout()
+    bool keepMeshData;            // keep the CPU copies of vertices and indices after the upload
+    size_t vertexBytesSaved = 0;  // by the compact layouts, compared to plain Vertex buffers
+    size_t cpuBytesReleased = 0;  // CPU copies of vertices and indices dropped after the upload
+    vector<MeshOptimizationStats> optimizationStats; // per mesh, only filled when the model was imported by assimp
+    float lodThreshold = 1.0f;    // largest error of a level of detail on screen, in pixels
+    bool useTextureArrays;        // every texture is a layer of a texture array, shared by the same size and format, see buildTextureArrays()
+    vector<unsigned int> textureArrays; // owned by the model, textures_loaded holds their layers
+    size_t texturesInArrays = 0;  // textures that share their array with others
+
+    // where the time of the last load went, in milliseconds; parse and convert are 0 for a load from the model cache
+    struct LoadTimes
+    {
+        double parse = 0.0;   // assimp import
+        double convert = 0.0; // assimp meshes to vertices and indices and decoding the textures, in parallel
+        double upload = 0.0;  // textures and buffers, on the thread of the context
+        bool fromCache = false;
+    } loadTimes;
+
+    // the postprocessing asked from assimp, part of the key of the model cache
+    static constexpr unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+    // largest position error a quantized mesh may have, in object space units
+    static constexpr float POSITION_TOLERANCE = 0.0001f;
+    // meshes with fewer triangles are always drawn as a whole, splitting them into meshlets doesn't pay off
+    static constexpr size_t MESHLET_MIN_TRIANGLES = 1024;
+    // levels of detail per mesh including the full one, each has half the triangles of the previous one
+    static constexpr int MAX_LODS = 5;
+    static constexpr size_t LOD_MIN_TRIANGLES = 256;
+    // the simplification stops when it would move the surface by more than this part of the mesh's diagonal
+    static constexpr float LOD_MAX_ERROR = 0.05f;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool loadTextures = false, bool gamma = false) : gammaCorrection(gamma), loadTexturesFromModel(loadTextures)
+    // with compressVertices the meshes may use the compact layouts, the shaders have to rebuild the bitangent then and
+    // take the position as aPos * positionScale + positionOffset (see Mesh::setPositionUniforms() and DrawUniforms);
+    // without keepMeshData the vertices and indices of the meshes are empty once they are on the GPU.
+    // with loadNow = false the model stays empty until prepare() and upload() are called, see there;
+    // with textureArrays the shaders sample every texture from a sampler2DArray at the layer given by Texture (the
+    // <sampler>Layer uniform), baked textures are decoded instead as they can't be layers
+    Model(string const &path, bool loadTextures = false, bool gamma = false, bool compressVertices = false, bool keepMeshData = false, bool loadNow = true,
+          bool textureArrays = false)
+        : gammaCorrection(gamma), loadTexturesFromModel(loadTextures), compressVertices(compressVertices), keepMeshData(keepMeshData),
+          useTextureArrays(textureArrays)
+    {
+        pending.reset(new PendingLoad());
+        pending->path = path;
+        if (!loadNow)
+            return;
+        prepare();
+        upload(std::numeric_limits<size_t>::max());
+    }
+
+    // a model of meshes built in code, e.g. a placeholder
+    Model(vector<Mesh> meshes)
+        : gammaCorrection(false), loadTexturesFromModel(false), compressVertices(false), keepMeshData(true), useTextureArrays(false)
+    {
+        this->meshes = std::move(meshes);
+    }
+
+    // a model owns its meshes and textures, so it can be moved but not copied
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+
+    Model(Model &&other) noexcept { *this = std::move(other); }
+
+    Model &operator=(Model &&other) noexcept
     {
-        loadModel(path);
+        if (this == &other)
+            return *this;
+        deleteTextures();
+        textures_loaded = std::move(other.textures_loaded);
+        other.textures_loaded.clear();
+        textureArrays = std::move(other.textureArrays);
+        other.textureArrays.clear();
+        useTextureArrays = other.useTextureArrays;
+        texturesInArrays = other.texturesInArrays;
+        meshes = std::move(other.meshes);
+        directory = std::move(other.directory);
+        gammaCorrection = other.gammaCorrection;
+        loadTexturesFromModel = other.loadTexturesFromModel;
+        compressVertices = other.compressVertices;
+        keepMeshData = other.keepMeshData;
+        vertexBytesSaved = other.vertexBytesSaved;
+        cpuBytesReleased = other.cpuBytesReleased;
+        optimizationStats = std::move(other.optimizationStats);
+        lodThreshold = other.lodThreshold;
+        loadTimes = other.loadTimes;
+        pending = std::move(other.pending);
+        return *this;
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader shader)
+    ~Model() { deleteTextures(); }
+
+    // draws the model, and thus all its meshes; meshes with the same textures and vertex layout share a draw call
+    void Draw(Shader &shader)
+    {
+        drawBatched(shader, vector<int>(meshes.size(), 0));
+    }
+
+    // draws only the meshlets that are visible from the camera; the shader has to use the same matrices
+    MeshletStats DrawCulled(Shader &shader, const glm::mat4 &projection, const glm::mat4 &view, const glm::mat4 &model, const glm::vec3 &cameraPos)
     {
+        // culling happens in model space
+        Frustum frustum(projection * view * model);
+        glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPos, 1.0f));
+        MeshletStats stats;
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].DrawCulled(shader, frustum, camera, stats);
+        return stats;
     }
-    
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+
+    // queues all meshes, to be drawn sorted by state when the queue is flushed
+    void Draw(RenderQueue &queue, Shader &shader, const glm::mat4 &model, float depth)
+    {
+        DrawUniforms uniforms(model);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            queue.submit(shader, meshes[i], uniforms, depth);
+    }
+
+    // draws every mesh at the coarsest level of detail whose error stays below lodThreshold pixels on screen
+    void Draw(Shader &shader, const Camera &camera, const glm::mat4 &model, float screenHeight)
+    {
+        vector<int> lods(meshes.size());
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            lods[i] = selectLod(meshes[i], camera, model, screenHeight);
+        drawBatched(shader, lods);
+    }
+
+    // queues every mesh at its level of detail, sorted by its distance to the camera
+    void Draw(RenderQueue &queue, Shader &shader, const Camera &camera, const glm::mat4 &model, float screenHeight)
     {
+        DrawUniforms uniforms(model);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            glm::vec3 center = glm::vec3(model * glm::vec4((meshes[i].boundsMin + meshes[i].boundsMax) * 0.5f, 1.0f));
+            queue.submit(shader, meshes[i], uniforms, glm::length(center - camera.Position), selectLod(meshes[i], camera, model, screenHeight));
+        }
+    }
+
+    // the part of the load that needs no GL context: maps the model cache, or imports and converts the meshes with
+    // assimp, and decodes the textures. Safe to call on a worker thread as long as nothing else uses the model meanwhile.
+    // ------------------------------------------------------------------------
+    void prepare()
+    {
+        if (!pending || pending->prepared)
+            return;
+        PendingLoad &load = *pending;
+        load.prepared = true;
+        const string &path = load.path;
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+        loadTimes = LoadTimes();
+
+        // a warm load maps the model cache and uploads from there, assimp isn't needed at all
+        if (load.cache.open(path, IMPORT_FLAGS, loadTexturesFromModel))
+        {
+            loadTimes.fromCache = true;
+            load.meshCount = load.cache.meshCount();
+            map<string, bool> textures;
+            for (std::uint32_t t = 0; t < load.cache.textureCount(); t++)
+                textures[load.cache.texturePath(t)] = isColorTexture(load.cache.textureType(t));
+            decodeTextures(textures);
+            return;
+        }
+
         // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        load.importer.reset(new Assimp::Importer());
+        const aiScene* scene = load.importer->ReadFile(path, IMPORT_FLAGS);
+        loadTimes.parse = millisecondsSince(t1);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            cout << "ERROR::ASSIMP:: " << load.importer->GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        load.scene = scene;
+        // collect the meshes of ASSIMP's nodes recursively, in the order they are drawn
+        processNode(scene->mRootNode, scene, load.sceneMeshes);
+
+        // converting a mesh only reads the scene, so all meshes are converted in parallel;
+        // every mesh writes its own slot, which keeps the order independent of the scheduling
+        auto t2 = std::chrono::high_resolution_clock::now();
+        load.converted.resize(load.sceneMeshes.size());
+        GetThreadPool().parallelFor(0, (int)load.sceneMeshes.size(), [&](int first, int last)
+                                    {
+                                        for (int i = first; i < last; i++)
+                                            load.converted[i] = convertMesh(load.sceneMeshes[i]);
+                                    });
+        load.meshCount = load.converted.size();
+
+        map<string, bool> textures;
+        if (loadTexturesFromModel)
+        {
+            for (const aiMesh *mesh : load.sceneMeshes)
+            {
+                aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+                for (aiTextureType type : {aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT})
+                {
+                    for (unsigned int i = 0; i < material->GetTextureCount(type); i++)
+                    {
+                        aiString str;
+                        material->GetTexture(type, i, &str);
+                        textures[str.C_Str()] = type == aiTextureType_DIFFUSE || type == aiTextureType_SPECULAR;
+                    }
+                }
+            }
+        }
+        decodeTextures(textures);
+        loadTimes.convert = millisecondsSince(t2);
+    }
+
+    // creates the buffers and textures of the prepared meshes on the thread of the GL context. Stops once about maxBytes
+    // of vertex and index data were uploaded, but uploads at least one mesh; returns true when the model is complete.
+    // ------------------------------------------------------------------------
+    bool upload(size_t maxBytes, size_t *uploadedBytes = nullptr)
+    {
+        if (uploadedBytes)
+            *uploadedBytes = 0;
+        if (!pending)
+            return true;
+        prepare(); // in case nobody did
+        PendingLoad &load = *pending;
+
+        // GL calls have to stay on this thread
+        auto t1 = std::chrono::high_resolution_clock::now();
+        if (useTextureArrays && !load.arraysBuilt)
+            buildTextureArrays();
+        meshes.reserve(load.meshCount);
+        size_t uploaded = 0;
+        while (load.nextMesh < load.meshCount && (uploaded == 0 || uploaded < maxBytes))
+        {
+            size_t i = load.nextMesh++;
+            if (loadTimes.fromCache)
+            {
+                uploaded += uploadCachedMesh(load.cache.mesh((std::uint32_t)i));
+                continue;
+            }
+            MeshData &data = load.converted[i];
+            uploaded += data.vertices.size() * sizeof(Vertex) + data.indices.size() * sizeof(unsigned int);
+            optimizationStats.push_back(data.stats);
+            meshes.push_back(uploadMesh(data, load.sceneMeshes[i], load.scene));
+        }
+        loadTimes.upload += millisecondsSince(t1);
+        if (uploadedBytes)
+            *uploadedBytes = uploaded;
+        if (load.nextMesh < load.meshCount)
+            return false;
+
+        if (load.scene)
+        {
+            ModelCache::store(load.path, IMPORT_FLAGS, loadTexturesFromModel, meshes);
+            if (!keepMeshData)
+                for(unsigned int i = 0; i < meshes.size(); i++)
+                    cpuBytesReleased += meshes[i].releaseCpuData();
+        }
+        pending.reset(); // the importer, the mapping and the decoded textures
+        return true;
+    }
+
+    // false while a model constructed with loadNow = false is not completely uploaded
+    bool isLoaded() const { return !pending; }
+
+    // memory held on the GPU: the parts of the MeshArena used by the meshes and the textures
+    size_t gpuBytes() const
+    {
+        size_t bytes = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            bytes += meshes[i].vertexBytes() + (size_t)meshes[i].indexCount * meshes[i].indexSize();
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+            if (textures_loaded[i].target == GL_TEXTURE_2D)
+                bytes += TextureBytes(textures_loaded[i].id);
+        for(unsigned int i = 0; i < textureArrays.size(); i++)
+            bytes += TextureBytes(textureArrays[i], GL_TEXTURE_2D_ARRAY);
+        return bytes;
+    }
+
+    // memory held on the CPU by the meshes: vertices and indices unless they were released, meshlets and levels of detail
+    size_t cpuBytes() const
+    {
+        size_t bytes = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            const Mesh &mesh = meshes[i];
+            bytes += mesh.vertices.capacity() * sizeof(Vertex) + mesh.indices.capacity() * sizeof(unsigned int) +
+                     mesh.meshlets.capacity() * sizeof(Meshlet) + mesh.lods.capacity() * sizeof(MeshLod);
+        }
+        return bytes;
+    }
+
+    // the level of detail of a mesh from its projected size: an object space unit at the distance of the mesh's
+    // bounds covers screenHeight / (2 tan(fov / 2)) * scale / distance pixels
+    int selectLod(const Mesh &mesh, const Camera &camera, const glm::mat4 &model, float screenHeight) const
+    {
+        if (mesh.lodCount() == 1)
+            return 0;
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        glm::vec3 center = glm::vec3(model * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+        float radius = 0.5f * glm::length(mesh.boundsMax - mesh.boundsMin) * scale;
+        float distance = glm::length(center - camera.Position) - radius;
+        if (distance <= 0.0f)
+            return 0; // inside the bounds
+        float pixelsPerUnit = screenHeight / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f)) * scale / distance;
+        return mesh.selectLod(pixelsPerUnit, lodThreshold);
+    }
+    
+private:
+    void deleteTextures()
+    {
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+            if (textures_loaded[i].target == GL_TEXTURE_2D)
+                glDeleteTextures(1, &textures_loaded[i].id);
+        textures_loaded.clear();
+        if (!textureArrays.empty())
+            glDeleteTextures((GLsizei)textureArrays.size(), textureArrays.data());
+        textureArrays.clear();
+    }
+
+    // draws the meshes at the given levels of detail with one glMultiDrawElementsBaseVertex per group of meshes that
+    // share textures, vertex array, index type and position scale and offset; groups that only use other layers of the
+    // bound texture arrays follow each other and skip the binds
+    void drawBatched(Shader &shader, const vector<int> &lods)
+    {
+        vector<vector<unsigned int>> batches;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            auto batch = std::find_if(batches.begin(), batches.end(), [&](const vector<unsigned int> &b)
+                                      { return sameDrawState(meshes[b[0]], meshes[i]); });
+            if (batch == batches.end())
+                batches.push_back({i});
+            else
+                batch->push_back(i);
+        }
+        std::stable_sort(batches.begin(), batches.end(), [&](const vector<unsigned int> &a, const vector<unsigned int> &b)
+                         { return textureIds(meshes[a[0]]) < textureIds(meshes[b[0]]); });
+
+        vector<GLsizei> counts;
+        vector<const void *> offsets;
+        vector<GLint> baseVertices;
+        const Mesh *bound = nullptr; // whose textures are bound
+        for (const vector<unsigned int> &batch : batches)
+        {
+            counts.clear();
+            offsets.clear();
+            baseVertices.clear();
+            for (unsigned int i : batch)
+            {
+                MeshLod level = meshes[i].getLod(lods[i]);
+                counts.push_back((GLsizei)level.indexCount);
+                offsets.push_back(meshes[i].indexPointer(level.firstIndex));
+                baseVertices.push_back(meshes[i].baseVertex());
+            }
+            Mesh &mesh = meshes[batch[0]];
+            if (!mesh.setPositionUniforms(shader))
+                continue;
+            if (bound && mesh.sameTextureBindings(*bound))
+                mesh.setTextureLayers(shader);
+            else
+                mesh.bindTextures(shader);
+            bound = &mesh;
+            glBindVertexArray(mesh.VAO);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), mesh.indexType, offsets.data(), (GLsizei)counts.size(), baseVertices.data());
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    static bool sameDrawState(const Mesh &a, const Mesh &b)
+    {
+        if (a.VAO != b.VAO || a.indexType != b.indexType || a.textures.size() != b.textures.size())
+            return false;
+        // quantized meshes are only drawn together if their positions map back to object space the same way
+        if (a.positionScale() != b.positionScale() || a.positionOffset() != b.positionOffset())
+            return false;
+        for (size_t i = 0; i < a.textures.size(); i++)
+            if (a.textures[i].id != b.textures[i].id || a.textures[i].layer != b.textures[i].layer)
+                return false;
+        return true;
+    }
+
+    static vector<unsigned int> textureIds(const Mesh &mesh)
+    {
+        vector<unsigned int> ids;
+        for (const Texture &texture : mesh.textures)
+            ids.push_back(texture.id);
+        return ids;
+    }
+
+    // creates a mesh from a model cache entry; it uploads straight from the mapping. Returns the bytes uploaded.
+    size_t uploadCachedMesh(const ModelCache::CachedMesh &mesh)
+    {
+        vector<Texture> textures;
+        for (std::uint32_t t = mesh.firstTexture; t < mesh.firstTexture + mesh.textureCount; t++)
+            textures.push_back(loadTextureOnce(pending->cache.texturePath(t), pending->cache.textureType(t)));
+        meshes.emplace_back(mesh.vertices, mesh.vertexCount, mesh.indices, mesh.indexCount, mesh.boundsMin, mesh.boundsMax, std::move(textures),
+                            chooseLayout(mesh.vertices, mesh.vertexCount));
+        meshes.back().meshlets.assign(mesh.meshlets, mesh.meshlets + mesh.meshletCount);
+        meshes.back().lods.assign(mesh.lods, mesh.lods + mesh.lodCount);
+        vertexBytesSaved += (size_t)mesh.vertexCount * sizeof(Vertex) - meshes.back().vertexBytes();
+        return meshes.back().vertexBytes() + (size_t)mesh.indexCount * meshes.back().indexSize();
+    }
+
+    VertexLayout chooseLayout(const Vertex *vertices, size_t vertexCount) const
+    {
+        return compressVertices ? Mesh::chooseLayout(vertices, vertexCount, POSITION_TOLERANCE) : VertexLayout::Float;
+    }
+
+    // the CPU side of a mesh, filled by a worker thread
+    struct MeshData
+    {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        MeshOptimizationStats stats;
+        vector<Meshlet> meshlets;
+        vector<MeshLod> lods;
+    };
+
+    // a load between the constructor and the end of upload(); the importer owns the scene until all meshes are uploaded
+    struct PendingLoad
+    {
+        string path;
+        bool prepared = false;
+        ModelCache cache;
+        std::unique_ptr<Assimp::Importer> importer;
+        const aiScene *scene = nullptr;
+        vector<aiMesh *> sceneMeshes;
+        vector<MeshData> converted;
+        map<string, DecodedImage> images; // decoded textures by their path relative to the model
+        map<string, Texture> arrayLayers;  // the textures that became layers of textureArrays, by their path
+        bool arraysBuilt = false;
+        size_t meshCount = 0;
+        size_t nextMesh = 0;
+    };
+    std::unique_ptr<PendingLoad> pending;
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+    // decodes the textures of the model (path -> holds color) and builds their mip chains in parallel, so upload()
+    // only has to create them
+    void decodeTextures(const map<string, bool> &textures)
+    {
+        vector<string> paths;
+        for (const auto &texture : textures)
+            paths.push_back(texture.first);
+        vector<DecodedImage> images(paths.size());
+        GetThreadPool().parallelFor(0, (int)paths.size(), [&](int first, int last)
+                                    {
+                                        for (int i = first; i < last; i++)
+                                        {
+                                            images[i] = decodeTexture(directory + '/' + paths[i], textures.at(paths[i]));
+                                            BuildMipLevels(images[i]);
+                                        }
+                                    });
+        for (size_t i = 0; i < paths.size(); i++)
+            pending->images.emplace(paths[i], std::move(images[i]));
+    }
+
+    // the decoded texture, or the baked one unless the model uses texture arrays: those are built from pixels
+    DecodedImage decodeTexture(const string &filename, bool color) const
+    {
+        if (!useTextureArrays)
+            return DecodeImage(filename, false, color);
+        DecodedImage image = DecodePixels(filename);
+        image.srgb = color;
+        return image;
+    }
+
+    // groups the decoded textures by size, channels, mip levels and color space; every group becomes one
+    // GL_TEXTURE_2D_ARRAY, so the meshes using them share the bindings. A texture without a partner gets an array of
+    // one layer, so the shaders sample every texture the same way.
+    void buildTextureArrays()
+    {
+        PendingLoad &load = *pending;
+        load.arraysBuilt = true;
+        map<std::tuple<int, int, int, size_t, bool>, vector<string>> groups;
+        for (const auto &entry : load.images)
+        {
+            const DecodedImage &image = entry.second;
+            if (image.levels.empty())
+                continue; // not decoded, see singleLayerTexture()
+            bool gamma = gammaCorrection && image.srgb;
+            groups[std::make_tuple(image.width, image.height, image.channels, image.levels.size(), gamma)].push_back(entry.first);
+        }
+
+        GLint maxLayers = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        for (const auto &group : groups)
+        {
+            const vector<string> &paths = group.second;
+            for (size_t first = 0, count; first < paths.size(); first += count)
+            {
+                count = std::min(paths.size() - first, (size_t)maxLayers);
+                vector<const DecodedImage *> layers;
+                for (size_t i = first; i < first + count; i++)
+                    layers.push_back(&load.images.at(paths[i]));
+                unsigned int id = TextureArrayFromImages(layers, std::get<4>(group.first));
+                textureArrays.push_back(id);
+                for (size_t i = first; i < first + count; i++)
+                {
+                    Texture &texture = load.arrayLayers[paths[i]];
+                    texture.id = id;
+                    texture.path = paths[i];
+                    texture.target = GL_TEXTURE_2D_ARRAY;
+                    texture.layer = (int)(i - first);
+                }
+                if (count > 1)
+                    texturesInArrays += count;
+            }
+        }
+    }
+
+    // an array of its own for a texture that wasn't decoded by prepare(); left empty if it can't be decoded, as
+    // TextureFromImage() leaves its texture
+    Texture singleLayerTexture(DecodedImage &image, bool gamma)
+    {
+        Texture texture;
+        texture.target = GL_TEXTURE_2D_ARRAY;
+        BuildMipLevels(image);
+        if (!image.levels.empty())
+            texture.id = TextureArrayFromImages({&image}, gamma);
+        else
+        {
+            glGenTextures(1, &texture.id);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, texture.id);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+        textureArrays.push_back(texture.id);
+        return texture;
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // diffuse and specular maps hold colors, normal and height maps hold data that must not be gamma corrected
+    static bool isColorTexture(const string &typeName)
     {
-        // process each mesh located at the current node
+        return typeName == "texture_diffuse" || typeName == "texture_specular";
+    }
+
+    static double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+    {
+        auto duration = std::chrono::high_resolution_clock::now() - start;
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / 1000.0;
+    }
+
+    // processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+    void processNode(aiNode *node, const aiScene *scene, vector<aiMesh *> &sceneMeshes)
+    {
+        // collect each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+        // after we've collected all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, sceneMeshes);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // extracts vertices and indices; runs on a worker thread, so no GL calls and no shared state in here
+    static MeshData convertMesh(const aiMesh *mesh)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve((size_t)mesh->mNumFaces * 3);
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -135,11 +675,62 @@ private:
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace &face = mesh->mFaces[i];
             // retrieve all indices of the face and store them in the indices vector
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
+        // weld and reorder for the vertex cache, overdraw and vertex fetch
+        data.stats = MeshOptimizer::optimize(vertices, indices);
+        size_t fullCount = indices.size();
+        buildLods(data);
+        // clusters of the optimized triangle order for culling at draw time, only for the full level of detail
+        if (fullCount / 3 >= MESHLET_MIN_TRIANGLES)
+            data.meshlets = BuildMeshlets(vertices.data(), indices.data(), fullCount);
+        return data;
+    }
+
+    // appends the simplified levels of detail to the index buffer; every level is simplified from the full mesh, so
+    // its error is measured against the original surface
+    static void buildLods(MeshData &data)
+    {
+        vector<unsigned int> &indices = data.indices;
+        if (indices.size() / 3 < 2 * LOD_MIN_TRIANGLES)
+            return;
+        glm::vec3 low = data.vertices[0].Position, high = low;
+        for (const Vertex &vertex : data.vertices)
+        {
+            low = glm::min(low, vertex.Position);
+            high = glm::max(high, vertex.Position);
+        }
+        float maxError = glm::length(high - low) * LOD_MAX_ERROR;
+
+        const vector<unsigned int> full = indices;
+        data.lods.push_back({0, (std::uint32_t)full.size(), 0.0f});
+        size_t previous = full.size();
+        for (int level = 1; level < MAX_LODS; level++)
+        {
+            size_t target = (full.size() / 3 >> level) * 3;
+            if (target / 3 < LOD_MIN_TRIANGLES)
+                break;
+            float error;
+            vector<unsigned int> simplified = MeshSimplifier::simplify(data.vertices, full, target, maxError, error);
+            if (simplified.size() > previous * 85 / 100)
+                break; // locked vertices or the error limit keep it from getting much smaller
+            MeshOptimizer::optimizeVertexCache(simplified, data.vertices.size());
+            data.lods.push_back({(std::uint32_t)indices.size(), (std::uint32_t)simplified.size(), error});
+            indices.insert(indices.end(), simplified.begin(), simplified.end());
+            previous = simplified.size();
+        }
+        if (data.lods.size() == 1)
+            data.lods.clear();
+    }
+
+    // loads the textures of a converted mesh and creates its buffers
+    Mesh uploadMesh(MeshData &data, const aiMesh *mesh, const aiScene *scene)
+    {
+        vector<Texture> textures;
+
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -166,7 +757,12 @@ private:
         }
         
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        VertexLayout layout = chooseLayout(data.vertices.data(), data.vertices.size());
+        vertexBytesSaved += data.vertices.size() * (sizeof(Vertex) - Mesh::vertexSize(layout));
+        Mesh result(std::move(data.vertices), std::move(data.indices), std::move(textures), layout);
+        result.meshlets = std::move(data.meshlets);
+        result.lods = std::move(data.lods);
+        return result;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -178,69 +774,252 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(loadTextureOnce(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // loads a texture of the model unless it was loaded before
+    Texture loadTextureOnce(const string &path, const string &typeName)
+    {
+        // check if texture was loaded before and if so, skip loading a new texture
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(textures_loaded[j].path == path)
+                return textures_loaded[j]; // a texture with the same filepath has already been loaded (optimization)
+        }
+        // if texture hasn't been loaded already, load it; prepare() decoded it already
+        Texture texture;
+        bool color = isColorTexture(typeName);
+        auto image = pending ? pending->images.find(path) : map<string, DecodedImage>::iterator();
+        auto layer = pending ? pending->arrayLayers.find(path) : map<string, Texture>::iterator();
+        if (pending && layer != pending->arrayLayers.end())
+            texture = layer->second; // buildTextureArrays() uploaded it already
+        else if (useTextureArrays)
+        {
+            DecodedImage decoded = decodeTexture(directory + '/' + path, color);
+            texture = singleLayerTexture(decoded, gammaCorrection && color);
+        }
+        else if (pending && image != pending->images.end())
+            texture.id = TextureFromImage(image->second, directory + '/' + path, gammaCorrection && color);
+        else
+        {
+            DecodedImage decoded = DecodeImage(directory + '/' + path, false, color);
+            texture.id = TextureFromImage(decoded, directory + '/' + path, gammaCorrection && color);
+        }
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
+    }
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+// turns an image upside down in place, bottom row first like OpenGL expects it
+void FlipRows(unsigned char *pixels, int width, int height, int channels)
 {
-    string filename = string(path);
-    filename = directory + '/' + filename;
+    size_t rowBytes = (size_t)width * channels;
+    std::vector<unsigned char> row(rowBytes);
+    for (int y = 0; y < height / 2; y++)
+    {
+        unsigned char *top = pixels + y * rowBytes, *bottom = pixels + (height - 1 - y) * rowBytes;
+        std::memcpy(row.data(), top, rowBytes);
+        std::memcpy(top, bottom, rowBytes);
+        std::memcpy(bottom, row.data(), rowBytes);
+    }
+}
+
+// decodes an image with stb_image, forcing channels unless it is 0, and flips it if asked to. stb_image's flip
+// setting is global and read by every ThreadPool worker that decodes, so it stays off: never set
+// stbi_set_flip_vertically_on_load while assets load, pass flipped instead.
+DecodedImage DecodePixels(const string &filename, bool flipped, int channels)
+{
+    DecodedImage image;
+    image.pixels.reset(stbi_load(filename.c_str(), &image.width, &image.height, &image.channels, channels));
+    if (channels != 0)
+        image.channels = channels;
+    if (image.pixels && flipped)
+        FlipRows(image.pixels.get(), image.width, image.height, image.channels);
+    return image;
+}
+
+// prefers the baked texture (see tex-bake) if there is one with the orientation asked for
+DecodedImage DecodeImage(const string &filename, bool flipped, bool srgb)
+{
+    DecodedImage image;
+    image.srgb = srgb;
+    image.baked = ReadKtx(filename + ".ktx");
+    if (image.baked.valid() && image.baked.flipped == flipped)
+    {
+        image.width = image.baked.width;
+        image.height = image.baked.height;
+        return image;
+    }
+    image = DecodePixels(filename, flipped);
+    image.srgb = srgb;
+    return image;
+}
+
+// replaces the pixels of a decoded image by its mip chain, resized to the power of two closest to its size if asked to.
+// Does the work on the ThreadPool, so it is best called from a task of it rather than on the render thread.
+void BuildMipLevels(DecodedImage &image, bool powerOf2)
+{
+    if (!image.pixels || image.width <= 0 || image.height <= 0)
+        return;
+    int width = powerOf2 ? ImageResampler::nearestPowerOf2(image.width) : image.width;
+    int height = powerOf2 ? ImageResampler::nearestPowerOf2(image.height) : image.height;
+    image.levels = ImageResampler::mipChain(image.pixels.get(), image.width, image.height, image.channels, image.srgb, width, height);
+    image.pixels.reset();
+    image.width = width;
+    image.height = height;
+}
+
+// the pixel format of decoded images with the given channels, and the format to store them in
+void ImageFormats(int channels, bool gamma, GLenum &format, GLint &internalFormat)
+{
+    static const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    format = formats[std::clamp(channels, 1, 4) - 1];
+    internalFormat = format;
+    if (gamma && channels == 3)
+        internalFormat = GL_SRGB8;
+    else if (gamma && channels == 4)
+        internalFormat = GL_SRGB8_ALPHA8;
+}
+
+// uploads every level of a mip chain into the bound 2D texture; gamma stores color in an sRGB format, so sampling
+// returns linear light
+void UploadImageLevels(const DecodedImage &image, bool gamma)
+{
+    GLenum format;
+    GLint internalFormat;
+    ImageFormats(image.channels, gamma, format, internalFormat);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of three channels aren't padded to four bytes
+    for (size_t level = 0; level < image.levels.size(); level++)
+    {
+        const ImageResampler::Level &mip = image.levels[level];
+        glTexImage2D(GL_TEXTURE_2D, (GLint)level, internalFormat, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE, mip.pixels.data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+}
+
+// a texture array with one layer per image; the images need the same size, channels and mip chain
+unsigned int TextureArrayFromImages(const vector<const DecodedImage *> &images, bool gamma)
+{
+    const DecodedImage &first = *images[0];
+    GLenum format;
+    GLint internalFormat;
+    ImageFormats(first.channels, gamma, format, internalFormat);
 
     unsigned int textureID;
     glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t level = 0; level < first.levels.size(); level++)
+    {
+        const ImageResampler::Level &mip = first.levels[level];
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, internalFormat, mip.width, mip.height, (GLsizei)images.size(), 0, format, GL_UNSIGNED_BYTE, nullptr);
+        for (size_t layer = 0; layer < images.size(); layer++)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, (GLint)layer, mip.width, mip.height, 1, format, GL_UNSIGNED_BYTE,
+                            images[layer]->levels[level].pixels.data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)first.levels.size() - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return textureID;
+}
+
+// builds the mip chain first unless it was built already
+unsigned int TextureFromImage(DecodedImage &image, const string &filename, bool gamma)
+{
+    if (image.baked.valid())
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
+        if (unsigned int baked = TextureFromKtx(image.baked, GL_REPEAT, gamma))
+            return baked;
+        // the GPU can't sample the baked format (or its sRGB variant), decode the image after all
+        DecodedImage decoded = DecodePixels(filename, image.baked.flipped);
+        decoded.srgb = image.srgb;
+        return TextureFromImage(decoded, filename, gamma);
+    }
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
 
+    BuildMipLevels(image);
+    if (!image.levels.empty())
+    {
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        UploadImageLevels(image, gamma);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
     }
     else
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        std::cout << "Texture failed to load at path: " << filename << std::endl;
     }
 
     return textureID;
 }
+
+// estimated GPU memory of a 2D, 2D array or cube map texture: level 0 as the driver stores it, plus a third if it has
+// mipmaps
+size_t TextureBytes(unsigned int id, GLenum target)
+{
+    GLint previous = 0;
+    if (target == GL_TEXTURE_CUBE_MAP)
+        glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, &previous);
+    else
+        glGetIntegerv(target == GL_TEXTURE_2D_ARRAY ? GL_TEXTURE_BINDING_2D_ARRAY : GL_TEXTURE_BINDING_2D, &previous);
+    glBindTexture(target, id);
+
+    GLenum image = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+    GLint width = 0, height = 0, layers = 1, compressed = 0, minFilter = 0;
+    glGetTexLevelParameteriv(image, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(image, 0, GL_TEXTURE_HEIGHT, &height);
+    if (target == GL_TEXTURE_2D_ARRAY)
+        glGetTexLevelParameteriv(image, 0, GL_TEXTURE_DEPTH, &layers);
+    glGetTexLevelParameteriv(image, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    glGetTexParameteriv(target, GL_TEXTURE_MIN_FILTER, &minFilter);
+    size_t bytes = 0;
+    if (compressed)
+    {
+        GLint size = 0;
+        glGetTexLevelParameteriv(image, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+        bytes = (size_t)size;
+    }
+    else
+    {
+        GLint bits = 0;
+        for (GLenum channel : {GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE})
+        {
+            GLint channelBits = 0;
+            glGetTexLevelParameteriv(image, 0, channel, &channelBits);
+            bits += channelBits;
+        }
+        bytes = (size_t)width * height * layers * bits / 8;
+    }
+    glBindTexture(target, (GLuint)previous);
+
+    if (minFilter != GL_NEAREST && minFilter != GL_LINEAR)
+        bytes += bytes / 3; // the mipmap chain
+    return target == GL_TEXTURE_CUBE_MAP ? 6 * bytes : bytes;
+}
+
+// gamma: the image holds color in sRGB, its mip levels are averaged in linear light and it is sampled as linear light
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+{
+    string filename = string(path);
+    filename = directory + '/' + filename;
+    DecodedImage image = DecodeImage(filename, false, gamma);
+    return TextureFromImage(image, filename, gamma);
+}
 #endif
@@ -0,0 +1,368 @@
+#ifndef MODELCACHE_H
+#define MODELCACHE_H
+
+#include <glm/glm.hpp>
+
+#include <util/mesh.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+            bytes = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void *view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED)
+            {
+                bytes = (const char *)view;
+                size = (size_t)info.st_size;
+                madvise(view, size, MADV_SEQUENTIAL | MADV_WILLNEED);
+            }
+        }
+        ::close(fd); // the mapping stays valid
+#endif
+        if (!bytes)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (bytes)
+            UnmapViewOfFile(bytes);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes)
+            munmap((void *)bytes, size);
+#endif
+        bytes = nullptr;
+        size = 0;
+    }
+
+    const char *data() const { return bytes; }
+    size_t getSize() const { return size; }
+
+private:
+    const char *bytes = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// A cache of imported models in modelcache/, one flat binary file per model. The file is keyed by the source path,
+// its modification time, the import flags and whether material textures are used, so editing the model or changing
+// the import invalidates it. A warm load maps the file and hands out pointers into the mapping, which the meshes
+// upload directly: no parsing, no copies.
+//
+// file layout (little endian, every section 16 byte aligned):
+//   Header, MeshRecord[meshCount], TextureRecord[textureCount], string data, then per mesh its vertices, indices
+//   meshlets and levels of detail
+class ModelCache
+{
+public:
+    static constexpr std::uint32_t VERSION = 4; // increase when the layout, the vertex format or the mesh processing changes
+
+    // a mesh as stored in the cache, the pointers point into the mapping
+    struct CachedMesh
+    {
+        const Vertex *vertices;
+        std::uint32_t vertexCount;
+        const unsigned int *indices;
+        std::uint32_t indexCount;
+        glm::vec3 boundsMin, boundsMax;
+        std::uint32_t firstTexture, textureCount; // range of textureType()/texturePath()
+        const Meshlet *meshlets;
+        std::uint32_t meshletCount;
+        const MeshLod *lods;
+        std::uint32_t lodCount;
+    };
+
+    // opens the cache entry of a model, fails if there is none or it is stale
+    // ------------------------------------------------------------------------
+    bool open(const std::string &path, unsigned int importFlags, bool withTextures)
+    {
+        if (!file.open(cachePath(path, importFlags, withTextures)) || file.getSize() < sizeof(Header))
+            return false;
+        header = (const Header *)file.data();
+        if (header->magic != MAGIC || header->version != VERSION || header->vertexSize != sizeof(Vertex) ||
+            header->meshletSize != sizeof(Meshlet) ||
+            header->sourceTime != sourceTime(path) || header->importFlags != importFlags ||
+            header->withTextures != (withTextures ? 1u : 0u) || header->fileSize != file.getSize())
+        {
+            file.close();
+            return false;
+        }
+        meshes = (const MeshRecord *)(file.data() + header->meshOffset);
+        textures = (const TextureRecord *)(file.data() + header->textureOffset);
+        return true;
+    }
+
+    std::uint32_t meshCount() const { return header->meshCount; }
+    std::uint32_t textureCount() const { return header->textureCount; }
+
+    CachedMesh mesh(std::uint32_t i) const
+    {
+        const MeshRecord &record = meshes[i];
+        CachedMesh mesh;
+        mesh.vertices = (const Vertex *)(file.data() + record.vertexOffset);
+        mesh.vertexCount = record.vertexCount;
+        mesh.indices = (const unsigned int *)(file.data() + record.indexOffset);
+        mesh.indexCount = record.indexCount;
+        mesh.boundsMin = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+        mesh.boundsMax = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+        mesh.meshlets = (const Meshlet *)(file.data() + record.meshletOffset);
+        mesh.meshletCount = record.meshletCount;
+        mesh.lods = (const MeshLod *)(file.data() + record.lodOffset);
+        mesh.lodCount = record.lodCount;
+        mesh.firstTexture = record.firstTexture;
+        mesh.textureCount = record.textureCount;
+        return mesh;
+    }
+
+    // sampler type (e.g. texture_diffuse) and path relative to the model of a texture reference
+    std::string textureType(std::uint32_t i) const { return std::string(file.data() + textures[i].typeOffset, textures[i].typeLength); }
+    std::string texturePath(std::uint32_t i) const { return std::string(file.data() + textures[i].pathOffset, textures[i].pathLength); }
+
+    // writes the meshes of a freshly imported model; textures are stored by their path relative to the model
+    // ------------------------------------------------------------------------
+    static void store(const std::string &path, unsigned int importFlags, bool withTextures, const std::vector<Mesh> &sourceMeshes)
+    {
+        std::vector<MeshRecord> meshRecords(sourceMeshes.size());
+        std::vector<TextureRecord> textureRecords;
+        std::string strings;
+        for (const Mesh &mesh : sourceMeshes)
+        {
+            for (const Texture &texture : mesh.textures)
+            {
+                TextureRecord record;
+                record.typeLength = (std::uint32_t)texture.type.size();
+                record.typeOffset = (std::uint32_t)strings.size();
+                strings += texture.type;
+                record.pathLength = (std::uint32_t)texture.path.size();
+                record.pathOffset = (std::uint32_t)strings.size();
+                strings += texture.path;
+                textureRecords.push_back(record);
+            }
+        }
+
+        Header header = {};
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.meshletSize = sizeof(Meshlet);
+        header.importFlags = importFlags;
+        header.withTextures = withTextures ? 1 : 0;
+        header.sourceTime = sourceTime(path);
+        header.meshCount = (std::uint32_t)sourceMeshes.size();
+        header.textureCount = (std::uint32_t)textureRecords.size();
+        header.meshOffset = align(sizeof(Header));
+        header.textureOffset = align(header.meshOffset + meshRecords.size() * sizeof(MeshRecord));
+        std::uint64_t stringOffset = align(header.textureOffset + textureRecords.size() * sizeof(TextureRecord));
+        for (TextureRecord &record : textureRecords)
+        {
+            record.typeOffset += (std::uint32_t)stringOffset;
+            record.pathOffset += (std::uint32_t)stringOffset;
+        }
+
+        std::uint64_t offset = align(stringOffset + strings.size());
+        std::uint32_t firstTexture = 0;
+        for (size_t i = 0; i < sourceMeshes.size(); i++)
+        {
+            const Mesh &mesh = sourceMeshes[i];
+            MeshRecord &record = meshRecords[i];
+            record.vertexOffset = offset;
+            record.vertexCount = (std::uint32_t)mesh.vertices.size();
+            offset = align(offset + mesh.vertices.size() * sizeof(Vertex));
+            record.indexOffset = offset;
+            record.indexCount = (std::uint32_t)mesh.indices.size();
+            offset = align(offset + mesh.indices.size() * sizeof(unsigned int));
+            record.meshletOffset = offset;
+            record.meshletCount = (std::uint32_t)mesh.meshlets.size();
+            offset = align(offset + mesh.meshlets.size() * sizeof(Meshlet));
+            record.lodOffset = offset;
+            record.lodCount = (std::uint32_t)mesh.lods.size();
+            offset = align(offset + mesh.lods.size() * sizeof(MeshLod));
+            for (int axis = 0; axis < 3; axis++)
+            {
+                record.boundsMin[axis] = mesh.boundsMin[axis];
+                record.boundsMax[axis] = mesh.boundsMax[axis];
+            }
+            record.firstTexture = firstTexture;
+            record.textureCount = (std::uint32_t)mesh.textures.size();
+            firstTexture += record.textureCount;
+        }
+        header.fileSize = offset;
+
+        std::error_code error;
+        std::filesystem::create_directories(DIRECTORY, error);
+        // write to a temporary file first, so a crash never leaves a truncated entry behind
+        std::string target = cachePath(path, importFlags, withTextures);
+        std::string temporary = target + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return;
+            auto writeAt = [&out](std::uint64_t position, const void *data, size_t size)
+            {
+                static const char zeros[ALIGNMENT] = {};
+                std::uint64_t current = (std::uint64_t)out.tellp();
+                if (position > current)
+                    out.write(zeros, (std::streamsize)(position - current)); // padding up to the aligned offset
+                out.write((const char *)data, (std::streamsize)size);
+            };
+            writeAt(0, &header, sizeof(header));
+            writeAt(header.meshOffset, meshRecords.data(), meshRecords.size() * sizeof(MeshRecord));
+            writeAt(header.textureOffset, textureRecords.data(), textureRecords.size() * sizeof(TextureRecord));
+            writeAt(stringOffset, strings.data(), strings.size());
+            for (size_t i = 0; i < sourceMeshes.size(); i++)
+            {
+                writeAt(meshRecords[i].vertexOffset, sourceMeshes[i].vertices.data(), sourceMeshes[i].vertices.size() * sizeof(Vertex));
+                writeAt(meshRecords[i].indexOffset, sourceMeshes[i].indices.data(), sourceMeshes[i].indices.size() * sizeof(unsigned int));
+                writeAt(meshRecords[i].meshletOffset, sourceMeshes[i].meshlets.data(), sourceMeshes[i].meshlets.size() * sizeof(Meshlet));
+                writeAt(meshRecords[i].lodOffset, sourceMeshes[i].lods.data(), sourceMeshes[i].lods.size() * sizeof(MeshLod));
+            }
+            writeAt(header.fileSize, nullptr, 0);
+            if (!out)
+                return;
+        }
+        std::filesystem::rename(temporary, target, error);
+        if (error)
+            std::cout << "WARNING::MODEL_CACHE : could not write " << target << std::endl;
+    }
+
+private:
+    static constexpr const char *DIRECTORY = "modelcache";
+    static constexpr std::uint32_t MAGIC = 0x4d475452; // "RTGM"
+    static constexpr std::uint64_t ALIGNMENT = 16;
+
+    struct Header
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t vertexSize;
+        std::uint32_t importFlags;
+        std::uint32_t withTextures;
+        std::uint32_t meshletSize;
+        std::int64_t sourceTime;
+        std::uint64_t fileSize;
+        std::uint32_t meshCount;
+        std::uint32_t textureCount;
+        std::uint64_t meshOffset;
+        std::uint64_t textureOffset;
+    };
+
+    struct MeshRecord
+    {
+        std::uint64_t vertexOffset;
+        std::uint64_t indexOffset;
+        std::uint64_t meshletOffset;
+        std::uint64_t lodOffset;
+        std::uint32_t vertexCount;
+        std::uint32_t indexCount;
+        float boundsMin[3];
+        float boundsMax[3];
+        std::uint32_t firstTexture;
+        std::uint32_t textureCount;
+        std::uint32_t meshletCount;
+        std::uint32_t lodCount;
+    };
+
+    struct TextureRecord
+    {
+        std::uint32_t typeOffset, typeLength;
+        std::uint32_t pathOffset, pathLength;
+    };
+
+    MappedFile file;
+    const Header *header = nullptr;
+    const MeshRecord *meshes = nullptr;
+    const TextureRecord *textures = nullptr;
+
+    static std::uint64_t align(std::uint64_t offset) { return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+    static std::int64_t sourceTime(const std::string &path)
+    {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(path, error);
+        return error ? 0 : (std::int64_t)time.time_since_epoch().count();
+    }
+
+    // the file name hashes the normalized source path and the options, the header also checks the modification time
+    static std::string cachePath(const std::string &path, unsigned int importFlags, bool withTextures)
+    {
+        std::string source = std::filesystem::path(path).lexically_normal().string();
+        std::uint64_t hash = 14695981039346656037ull;
+        for (char c : source)
+            hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+        for (int i = 0; i < 4; i++)
+            hash = (hash ^ ((importFlags >> (8 * i)) & 0xff)) * 1099511628211ull;
+        hash = (hash ^ (withTextures ? 1u : 0u)) * 1099511628211ull;
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+        return std::string(DIRECTORY) + "/" + name;
+    }
+};
+#endif
@@ -0,0 +1,184 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// A persistent cache of linked programs (glGetProgramBinary/glProgramBinary), one file per program in shadercache/.
+// Entries are keyed by a hash of the final source text of all stages, which includes any defines, and of the driver's
+// vendor, renderer and version strings; so a driver update or an edited shader simply misses the cache.
+// Binaries the driver rejects are ignored and the program is compiled again.
+class ProgramCache
+{
+public:
+    // true if the context can save and load program binaries (GL 4.1 or ARB_get_program_binary)
+    // ------------------------------------------------------------------------
+    static bool isSupported()
+    {
+        static int supported = -1;
+        if (supported < 0)
+        {
+            GLint formats = 0;
+#ifdef GL_NUM_PROGRAM_BINARY_FORMATS
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            glGetError(); // an unknown enum on contexts without program binaries
+#endif
+            supported = formats > 0 ? 1 : 0;
+        }
+        return supported == 1;
+    }
+
+    // true if the driver compiles and links in the background (KHR/ARB_parallel_shader_compile), so the status of a
+    // program should only be queried once GL_COMPLETION_STATUS_KHR reports that it is done
+    // ------------------------------------------------------------------------
+    static bool hasParallelCompile()
+    {
+        static int supported = -1;
+        if (supported < 0)
+        {
+            supported = 0;
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++)
+            {
+                const char *name = (const char *)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+                if (name && (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0))
+                    supported = 1;
+            }
+        }
+        return supported == 1;
+    }
+
+    // 64 bit FNV-1a hash over the sources and the driver identification
+    // ------------------------------------------------------------------------
+    static std::uint64_t key(const std::vector<std::string> &sources)
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](const char *data, size_t size)
+        {
+            for (size_t i = 0; i < size; i++)
+                hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+            hash = (hash ^ 0xff) * 1099511628211ull; // separator, so moving text between stages changes the key
+        };
+        for (const std::string &source : sources)
+            add(source.data(), source.size());
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const char *value = (const char *)glGetString(name);
+            if (value)
+                add(value, std::strlen(value));
+        }
+        return hash;
+    }
+
+    // loads the cached binary into program; returns false if there is none or the driver rejects it
+    // ------------------------------------------------------------------------
+    static bool load(GLuint program, std::uint64_t key)
+    {
+        if (!isSupported())
+            return false;
+        std::ifstream file(path(key), std::ios::binary);
+        if (!file)
+            return false;
+        Header header;
+        if (!file.read((char *)&header, sizeof(header)) || header.magic != MAGIC)
+            return false;
+        // a truncated or corrupt entry must not size the buffer, it is discarded instead
+        std::error_code error;
+        std::uintmax_t fileSize = std::filesystem::file_size(path(key), error);
+        if (error || header.length == 0 || header.length > fileSize - sizeof(header))
+        {
+            file.close();
+            std::filesystem::remove(path(key), error);
+            return false;
+        }
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), header.length))
+            return false;
+
+#ifdef GL_NUM_PROGRAM_BINARY_FORMATS
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)header.length);
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (success)
+            return true;
+        std::cout << "WARNING::PROGRAM_CACHE : cached binary was rejected, compiling again" << std::endl;
+#endif
+        return false;
+    }
+
+    // writes the binary of a successfully linked program
+    // ------------------------------------------------------------------------
+    static void store(GLuint program, std::uint64_t key)
+    {
+        if (!isSupported())
+            return;
+#ifdef GL_NUM_PROGRAM_BINARY_FORMATS
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        Header header = {MAGIC, 0, 0};
+        glGetProgramBinary(program, length, nullptr, &header.format, binary.data());
+        header.length = (std::uint32_t)length;
+
+        std::error_code error;
+        std::filesystem::create_directories(DIRECTORY, error);
+        // write to a temporary file first, so a crash never leaves a truncated entry behind
+        std::string target = path(key);
+        std::string temporary = target + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file)
+                return;
+            file.write((const char *)&header, sizeof(header));
+            file.write(binary.data(), length);
+        }
+        std::filesystem::rename(temporary, target, error);
+        if (error)
+            std::cout << "WARNING::PROGRAM_CACHE : could not write " << target << std::endl;
+#endif
+    }
+
+    // tell the driver that the binary of the program will be read back after linking
+    // ------------------------------------------------------------------------
+    static void prepareForStore(GLuint program)
+    {
+#ifdef GL_NUM_PROGRAM_BINARY_FORMATS
+        if (isSupported())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+    }
+
+private:
+    static constexpr const char *DIRECTORY = "shadercache";
+    static constexpr std::uint32_t MAGIC = 0x42475452; // "RTGB"
+
+    struct Header
+    {
+        std::uint32_t magic;
+        GLenum format;
+        std::uint32_t length;
+    };
+
+    static std::string path(std::uint64_t key)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return std::string(DIRECTORY) + "/" + name;
+    }
+};
+#endif
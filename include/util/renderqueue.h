@@ -0,0 +1,216 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h>
+
+#include <util/mesh.h>
+#include <util/shader.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+// Collects the draws of a frame and executes them sorted by a 64 bit key, so that draws with the same program, the
+// same textures and the same vertex array follow each other and the binds in between can be skipped.
+//
+// key layout, most expensive state change first:
+//   program (16 bits) | material, i.e. the set of textures (16 bits) | vertex array (16 bits) | depth (16 bits)
+// Within the same state the draws run front to back, which helps early depth testing. Neighbors in that order that
+// share all state and their uniforms (e.g. the meshes of one model) are drawn by one glMultiDrawElementsBaseVertex,
+// as all meshes of a vertex layout live in the same buffers (see MeshArena). The material only holds texture ids, so
+// meshes using different layers of the same texture arrays share it and just set their layer uniforms in between.
+class RenderQueue
+{
+public:
+    // state changes done and avoided by flush(), summed up since the last beginFrame()
+    struct Stats
+    {
+        size_t draws = 0;     // meshes drawn
+        size_t drawCalls = 0; // glMultiDrawElementsBaseVertex calls they took
+        size_t programBinds = 0, programsSkipped = 0;
+        size_t textureBinds = 0, texturesSkipped = 0;
+        size_t vertexArrayBinds = 0, vertexArraysSkipped = 0;
+    };
+
+    // reset the statistics, call once per frame
+    void beginFrame() { stats = Stats(); }
+
+    const Stats &getStats() const { return stats; }
+    size_t size() const { return commands.size(); }
+
+    // queues a mesh at a level of detail; depth is the distance to the camera, uniforms are staged in the draw uniform
+    // ring by flush() with the position scale and offset of the mesh. The shader and the mesh have to stay alive until
+    // the queue is flushed.
+    // ------------------------------------------------------------------------
+    void submit(Shader &shader, const Mesh &mesh, const DrawUniforms &uniforms, float depth, int lod = 0)
+    {
+        DrawCommand command;
+        command.shader = &shader;
+        command.mesh = &mesh;
+        command.lod = mesh.getLod(lod);
+        command.uniforms = uniforms;
+        command.uniforms.positionScale = glm::vec4(mesh.positionScale(), 1.0f);
+        command.uniforms.positionOffset = glm::vec4(mesh.positionOffset(), 0.0f);
+        command.key = makeKey(shader.ID, materialId(mesh), mesh.VAO, depth);
+        commands.push_back(command);
+    }
+
+    // executes all queued draws in the order of their keys and empties the queue; the uniforms of all draw calls are
+    // staged in the ring and uploaded at once before the first draw. Without a ring the draws use whatever
+    // DrawUniforms block is bound.
+    // ------------------------------------------------------------------------
+    void flush(UniformRing *drawUniforms = nullptr)
+    {
+        std::sort(commands.begin(), commands.end(), [](const DrawCommand &a, const DrawCommand &b)
+                  { return a.key < b.key; });
+
+        // the commands that only differ in their mesh join one draw call
+        calls.clear();
+        for (size_t begin = 0, end; begin < commands.size(); begin = end)
+        {
+            for (end = begin + 1; end < commands.size() && canMerge(commands[begin], commands[end]); end++)
+                ;
+            calls.push_back({begin, end, drawUniforms ? drawUniforms->stage(commands[begin].uniforms) : -1});
+        }
+        if (drawUniforms)
+            drawUniforms->upload();
+
+        // nothing is known about the state that was set outside of the queue
+        GLuint program = 0;
+        GLuint vertexArray = 0;
+        GLuint boundTextures[MAX_TEXTURE_UNITS] = {};
+        bool first = true;
+        for (const DrawCall &call : calls)
+        {
+            const DrawCommand &command = commands[call.begin];
+            Shader &shader = *command.shader;
+            if (first || shader.ID != program)
+            {
+                shader.use();
+                program = shader.ID;
+                stats.programBinds++;
+            }
+            else
+                stats.programsSkipped++;
+
+            const Mesh &mesh = *command.mesh;
+            const vector<UniformId> &samplers = mesh.getSamplerNames();
+            for (unsigned int i = 0; i < mesh.textures.size() && i < MAX_TEXTURE_UNITS; i++)
+            {
+                // the sampler uniform is skipped by the shader if it already points to this unit
+                shader.setInt(samplers[i], (int)i);
+                if (!first && boundTextures[i] == mesh.textures[i].id)
+                {
+                    stats.texturesSkipped++;
+                    continue;
+                }
+                glActiveTexture(GL_TEXTURE0 + i);
+                glBindTexture(mesh.textures[i].target, mesh.textures[i].id);
+                boundTextures[i] = mesh.textures[i].id;
+                stats.textureBinds++;
+            }
+            // meshes sharing texture arrays only differ in their layers, which are uniforms
+            mesh.setTextureLayers(shader);
+
+            if (first || mesh.VAO != vertexArray)
+            {
+                glBindVertexArray(mesh.VAO);
+                vertexArray = mesh.VAO;
+                stats.vertexArrayBinds++;
+            }
+            else
+                stats.vertexArraysSkipped++;
+
+            drawCounts.clear();
+            drawOffsets.clear();
+            drawBaseVertices.clear();
+            for (size_t i = call.begin; i < call.end; i++)
+            {
+                const DrawCommand &merged = commands[i];
+                drawCounts.push_back((GLsizei)merged.lod.indexCount);
+                drawOffsets.push_back(merged.mesh->indexPointer(merged.lod.firstIndex));
+                drawBaseVertices.push_back(merged.mesh->baseVertex());
+            }
+
+            if (drawUniforms)
+                drawUniforms->bind(call.uniformBlock);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), mesh.indexType, drawOffsets.data(),
+                                          (GLsizei)drawCounts.size(), drawBaseVertices.data());
+            stats.draws += drawCounts.size();
+            stats.drawCalls++;
+            first = false;
+        }
+        commands.clear();
+
+        // always good practice to set everything back to defaults once configured.
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // builds the sort key; ids beyond 16 bits are folded, which only costs a few skipped binds
+    // ------------------------------------------------------------------------
+    static std::uint64_t makeKey(GLuint program, std::uint32_t material, GLuint vertexArray, float depth)
+    {
+        // the bits of a non negative float sort like the float itself, the upper half keeps sign, exponent and 7 bits of mantissa
+        std::uint32_t depthBits;
+        depth = std::max(depth, 0.0f);
+        std::memcpy(&depthBits, &depth, sizeof(depthBits));
+        return ((std::uint64_t)(program & 0xffff) << 48) | ((std::uint64_t)(material & 0xffff) << 32) |
+               ((std::uint64_t)(vertexArray & 0xffff) << 16) | (depthBits >> 16);
+    }
+
+private:
+    static constexpr unsigned int MAX_TEXTURE_UNITS = 16;
+
+    struct DrawCommand
+    {
+        std::uint64_t key;
+        Shader *shader;
+        const Mesh *mesh;
+        MeshLod lod;
+        DrawUniforms uniforms;
+    };
+
+    // a range of sorted commands drawn by one glMultiDrawElementsBaseVertex
+    struct DrawCall
+    {
+        size_t begin, end;
+        int uniformBlock; // in the ring, see UniformRing::stage()
+    };
+
+    std::vector<DrawCommand> commands;
+    std::vector<DrawCall> calls; // of the current flush, kept to avoid allocations
+    std::vector<GLsizei> drawCounts; // arguments of the current multi draw, kept to avoid allocations
+    std::vector<const void *> drawOffsets;
+    std::vector<GLint> drawBaseVertices;
+    std::map<std::vector<GLuint>, std::uint32_t> materials; // texture ids -> material id, 0 is no textures
+    Stats stats;
+
+    // true if b can be drawn by the same call as a: same program, textures, buffers, index type and uniforms
+    static bool canMerge(const DrawCommand &a, const DrawCommand &b)
+    {
+        if (a.shader->ID != b.shader->ID || a.mesh->VAO != b.mesh->VAO || a.mesh->indexType != b.mesh->indexType)
+            return false;
+        if (a.mesh->textures.size() != b.mesh->textures.size())
+            return false;
+        for (size_t i = 0; i < a.mesh->textures.size(); i++)
+            if (a.mesh->textures[i].id != b.mesh->textures[i].id || a.mesh->textures[i].layer != b.mesh->textures[i].layer)
+                return false;
+        return std::memcmp(&a.uniforms, &b.uniforms, sizeof(DrawUniforms)) == 0;
+    }
+
+    std::uint32_t materialId(const Mesh &mesh)
+    {
+        if (mesh.textures.empty())
+            return 0;
+        std::vector<GLuint> ids;
+        ids.reserve(mesh.textures.size());
+        for (const Texture &texture : mesh.textures)
+            ids.push_back(texture.id);
+        auto it = materials.emplace(std::move(ids), (std::uint32_t)materials.size() + 1).first;
+        return it->second;
+    }
+};
+#endif
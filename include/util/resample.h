@@ -0,0 +1,404 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <util/threadpool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RESAMPLE_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLE_NEON 1
+#endif
+
+// Resizes 8 bit images and builds their mip chains on the CPU, so textures can be uploaded level by level instead of
+// waiting for glGenerateMipmap, and projects panoramas onto cube maps. Images are filtered as four floats per pixel,
+// one SIMD register (SSE or NEON), and the rows are split over the ThreadPool.
+// Color in sRGB is converted to linear light first, so mip levels keep the brightness of the image instead of darkening
+// its high contrast parts; only the color channels of three and four channel images are treated that way, alpha and
+// one or two channel images (heights, roughness, ...) are averaged as they are.
+class ImageResampler
+{
+public:
+    struct Level
+    {
+        int width = 0, height = 0;
+        std::vector<unsigned char> pixels; // rows top to bottom without padding
+    };
+
+    // the power of two closest to n on a logarithmic scale, e.g. 600 -> 512 and 800 -> 1024
+    static int nearestPowerOf2(int n)
+    {
+        long long power = 1;
+        while (power * 2 <= n)
+            power *= 2;
+        return (int)((long long)n * n < 2 * power * power ? power : 2 * power);
+    }
+
+    // the mip chain of an image down to 1x1; level 0 is the image resized to baseWidth x baseHeight
+    // ------------------------------------------------------------------------
+    static std::vector<Level> mipChain(const unsigned char *pixels, int width, int height, int channels, bool srgb, int baseWidth, int baseHeight)
+    {
+        bool color = srgb && channels >= 3;
+        FloatImage image = toFloat(pixels, width, height, channels, color);
+        if (baseWidth != width || baseHeight != height)
+            image = resize(image, baseWidth, baseHeight);
+
+        std::vector<Level> levels;
+        while (true)
+        {
+            levels.push_back(toBytes(image, channels, color));
+            if (image.width == 1 && image.height == 1)
+                break;
+            // odd sizes can't be averaged in 2x2 blocks, they take the filter
+            if (image.width % 2 == 0 && image.height % 2 == 0)
+                image = halve(image);
+            else
+                image = resize(image, std::max(image.width / 2, 1), std::max(image.height / 2, 1));
+        }
+        return levels;
+    }
+
+    // resizes an image with a Mitchell-Netravali filter, which blurs less than bilinear and rings less than Lanczos
+    // ------------------------------------------------------------------------
+    static Level resize(const unsigned char *pixels, int width, int height, int channels, bool srgb, int newWidth, int newHeight)
+    {
+        bool color = srgb && channels >= 3;
+        return toBytes(resize(toFloat(pixels, width, height, channels, color), newWidth, newHeight), channels, color);
+    }
+
+    // projects an equirectangular panorama (longitude along x with -z in the middle, up at the top) onto the six faces
+    // of a cube map, faceSize pixels square and in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i. Samples bilinearly
+    // and wraps around in longitude; rows of all faces are split over the ThreadPool together.
+    // ------------------------------------------------------------------------
+    static std::vector<Level> equirectangularToCube(const unsigned char *pixels, int width, int height, int channels, bool srgb, int faceSize)
+    {
+        const float PI = 3.14159265358979f;
+        bool color = srgb && channels >= 3;
+        FloatImage panorama = toFloat(pixels, width, height, channels, color);
+        std::vector<FloatImage> faces(6);
+        for (FloatImage &face : faces)
+        {
+            face.width = face.height = faceSize;
+            face.pixels.resize((size_t)faceSize * faceSize * 4);
+        }
+        GetThreadPool().parallelFor(0, 6 * faceSize, [&](int first, int last)
+                                    {
+                                        for (int row = first; row < last; row++)
+                                        {
+                                            int face = row / faceSize, y = row % faceSize;
+                                            float *out = &faces[face].pixels[(size_t)y * faceSize * 4];
+                                            float t = 2.0f * (y + 0.5f) / faceSize - 1.0f;
+                                            for (int x = 0; x < faceSize; x++)
+                                            {
+                                                float s = 2.0f * (x + 0.5f) / faceSize - 1.0f;
+                                                float d[3];
+                                                cubeDirection(face, s, t, d);
+                                                float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+                                                float u = (std::atan2(d[0], -d[2]) / (2.0f * PI) + 0.5f) * width - 0.5f;
+                                                float v = std::acos(std::clamp(d[1] / length, -1.0f, 1.0f)) / PI * height - 0.5f;
+                                                sampleBilinear(panorama, u, v).store(out + 4 * x);
+                                            }
+                                        }
+                                    },
+                                    ROWS_PER_SLICE);
+
+        std::vector<Level> levels;
+        for (const FloatImage &face : faces)
+            levels.push_back(toBytes(face, channels, color));
+        return levels;
+    }
+
+private:
+    static constexpr int ROWS_PER_SLICE = 16;
+
+    // four floats per pixel, color in linear light
+    struct FloatImage
+    {
+        int width = 0, height = 0;
+        std::vector<float> pixels;
+    };
+
+    // one pixel in a SIMD register
+    struct Float4
+    {
+#if defined(RESAMPLE_SSE)
+        __m128 v;
+        static Float4 zero() { return {_mm_setzero_ps()}; }
+        static Float4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+        void store(float *p) const { _mm_storeu_ps(p, v); }
+        void addScaled(const Float4 &a, float weight) { v = _mm_add_ps(v, _mm_mul_ps(a.v, _mm_set1_ps(weight))); }
+#elif defined(RESAMPLE_NEON)
+        float32x4_t v;
+        static Float4 zero() { return {vdupq_n_f32(0.0f)}; }
+        static Float4 load(const float *p) { return {vld1q_f32(p)}; }
+        void store(float *p) const { vst1q_f32(p, v); }
+        void addScaled(const Float4 &a, float weight) { v = vmlaq_n_f32(v, a.v, weight); }
+#else
+        float v[4];
+        static Float4 zero() { return {{0.0f, 0.0f, 0.0f, 0.0f}}; }
+        static Float4 load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+        void store(float *p) const { std::copy(v, v + 4, p); }
+        void addScaled(const Float4 &a, float weight)
+        {
+            for (int c = 0; c < 4; c++)
+                v[c] += a.v[c] * weight;
+        }
+#endif
+    };
+
+    // linear light of the 256 sRGB values, and the linear light halfway between two of them for rounding back
+    struct SrgbTables
+    {
+        float toLinear[256];
+        float thresholds[255];
+        unsigned char fromLinear[4097]; // the sRGB value of k / 4096, rounded down; at most one threshold lies in between
+
+        SrgbTables()
+        {
+            for (int i = 0; i < 256; i++)
+                toLinear[i] = decode(i / 255.0f);
+            for (int i = 0; i < 255; i++)
+                thresholds[i] = decode((i + 0.5f) / 255.0f);
+            for (int k = 0; k <= 4096; k++)
+                fromLinear[k] = (unsigned char)(std::upper_bound(thresholds, thresholds + 255, k / 4096.0f) - thresholds);
+        }
+
+        unsigned char encode(float linear) const
+        {
+            if (!(linear > 0.0f))
+                return 0;
+            if (linear >= 1.0f)
+                return 255;
+            int value = fromLinear[(int)(linear * 4096.0f)];
+            while (value < 255 && linear >= thresholds[value])
+                value++;
+            return (unsigned char)value;
+        }
+
+        static float decode(float value) { return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f); }
+    };
+
+    static const SrgbTables &srgbTables()
+    {
+        static const SrgbTables tables;
+        return tables;
+    }
+
+    static FloatImage toFloat(const unsigned char *pixels, int width, int height, int channels, bool color)
+    {
+        FloatImage image;
+        image.width = width;
+        image.height = height;
+        image.pixels.resize((size_t)width * height * 4);
+        const SrgbTables &srgb = srgbTables();
+        GetThreadPool().parallelFor(0, height, [&](int first, int last)
+                                    {
+                                        for (size_t i = (size_t)first * width; i < (size_t)last * width; i++)
+                                        {
+                                            float *out = &image.pixels[i * 4];
+                                            out[0] = out[1] = out[2] = 0.0f;
+                                            out[3] = 1.0f;
+                                            for (int c = 0; c < channels && c < 4; c++)
+                                            {
+                                                unsigned char value = pixels[i * channels + c];
+                                                out[c] = color && c < 3 ? srgb.toLinear[value] : value / 255.0f;
+                                            }
+                                        }
+                                    },
+                                    ROWS_PER_SLICE);
+        return image;
+    }
+
+    static Level toBytes(const FloatImage &image, int channels, bool color)
+    {
+        Level level;
+        level.width = image.width;
+        level.height = image.height;
+        level.pixels.resize((size_t)image.width * image.height * channels);
+        const SrgbTables &srgb = srgbTables();
+        GetThreadPool().parallelFor(0, image.height, [&](int first, int last)
+                                    {
+                                        for (size_t i = (size_t)first * image.width; i < (size_t)last * image.width; i++)
+                                        {
+                                            const float *in = &image.pixels[i * 4];
+                                            for (int c = 0; c < channels && c < 4; c++)
+                                            {
+                                                unsigned char value;
+                                                if (color && c < 3)
+                                                    value = srgb.encode(in[c]);
+                                                else
+                                                    value = (unsigned char)std::clamp((int)(in[c] * 255.0f + 0.5f), 0, 255);
+                                                level.pixels[i * channels + c] = value;
+                                            }
+                                        }
+                                    },
+                                    ROWS_PER_SLICE);
+        return level;
+    }
+
+    // averages 2x2 pixels of an image with even width and height
+    static FloatImage halve(const FloatImage &image)
+    {
+        FloatImage result;
+        result.width = image.width / 2;
+        result.height = image.height / 2;
+        result.pixels.resize((size_t)result.width * result.height * 4);
+        GetThreadPool().parallelFor(0, result.height, [&](int first, int last)
+                                    {
+                                        for (int y = first; y < last; y++)
+                                        {
+                                            const float *top = &image.pixels[(size_t)(2 * y) * image.width * 4];
+                                            const float *bottom = top + (size_t)image.width * 4;
+                                            float *out = &result.pixels[(size_t)y * result.width * 4];
+                                            for (int x = 0; x < result.width; x++)
+                                            {
+                                                Float4 sum = Float4::zero();
+                                                sum.addScaled(Float4::load(top + 8 * x), 0.25f);
+                                                sum.addScaled(Float4::load(top + 8 * x + 4), 0.25f);
+                                                sum.addScaled(Float4::load(bottom + 8 * x), 0.25f);
+                                                sum.addScaled(Float4::load(bottom + 8 * x + 4), 0.25f);
+                                                sum.store(out + 4 * x);
+                                            }
+                                        }
+                                    },
+                                    ROWS_PER_SLICE);
+        return result;
+    }
+
+    // the direction of a texel of a cube map face, s and t in [-1, 1] from its left and top edge (the GL convention)
+    static void cubeDirection(int face, float s, float t, float d[3])
+    {
+        switch (face)
+        {
+        case 0: d[0] = 1.0f, d[1] = -t, d[2] = -s; break;
+        case 1: d[0] = -1.0f, d[1] = -t, d[2] = s; break;
+        case 2: d[0] = s, d[1] = 1.0f, d[2] = t; break;
+        case 3: d[0] = s, d[1] = -1.0f, d[2] = -t; break;
+        case 4: d[0] = s, d[1] = -t, d[2] = 1.0f; break;
+        default: d[0] = -s, d[1] = -t, d[2] = -1.0f; break;
+        }
+    }
+
+    // x wraps around, y is clamped to the image
+    static Float4 sampleBilinear(const FloatImage &image, float x, float y)
+    {
+        float fx = std::floor(x), fy = std::floor(y);
+        float wx = x - fx, wy = y - fy;
+        int x0 = (((int)fx % image.width) + image.width) % image.width, x1 = (x0 + 1) % image.width;
+        int y0 = std::clamp((int)fy, 0, image.height - 1), y1 = std::clamp((int)fy + 1, 0, image.height - 1);
+        const float *top = &image.pixels[(size_t)y0 * image.width * 4], *bottom = &image.pixels[(size_t)y1 * image.width * 4];
+        Float4 sum = Float4::zero();
+        sum.addScaled(Float4::load(top + 4 * x0), (1.0f - wx) * (1.0f - wy));
+        sum.addScaled(Float4::load(top + 4 * x1), wx * (1.0f - wy));
+        sum.addScaled(Float4::load(bottom + 4 * x0), (1.0f - wx) * wy);
+        sum.addScaled(Float4::load(bottom + 4 * x1), wx * wy);
+        return sum;
+    }
+
+    static float mitchell(float x)
+    {
+        const float B = 1.0f / 3.0f, C = 1.0f / 3.0f;
+        x = std::fabs(x);
+        if (x < 1.0f)
+            return ((12.0f - 9.0f * B - 6.0f * C) * x * x * x + (-18.0f + 12.0f * B + 6.0f * C) * x * x + (6.0f - 2.0f * B)) / 6.0f;
+        if (x < 2.0f)
+            return ((-B - 6.0f * C) * x * x * x + (6.0f * B + 30.0f * C) * x * x + (-12.0f * B - 48.0f * C) * x + (8.0f * B + 24.0f * C)) / 6.0f;
+        return 0.0f;
+    }
+
+    // the source pixels and weights of each destination pixel along one axis, as ranges [offsets[i], offsets[i + 1])
+    struct Taps
+    {
+        std::vector<int> offsets, sources;
+        std::vector<float> weights;
+    };
+
+    static Taps computeTaps(int size, int newSize)
+    {
+        Taps taps;
+        float scale = (float)size / newSize;
+        float spread = std::max(scale, 1.0f); // when shrinking the filter covers all source pixels of a destination pixel
+        float radius = 2.0f * spread;
+        taps.offsets.push_back(0);
+        for (int i = 0; i < newSize; i++)
+        {
+            float center = (i + 0.5f) * scale - 0.5f;
+            int first = (int)std::floor(center - radius), last = (int)std::ceil(center + radius);
+            float total = 0.0f;
+            size_t begin = taps.weights.size();
+            for (int s = first; s <= last; s++)
+            {
+                float weight = mitchell((s - center) / spread);
+                if (weight == 0.0f)
+                    continue;
+                taps.sources.push_back(std::clamp(s, 0, size - 1));
+                taps.weights.push_back(weight);
+                total += weight;
+            }
+            for (size_t t = begin; t < taps.weights.size(); t++)
+                taps.weights[t] /= total;
+            taps.offsets.push_back((int)taps.weights.size());
+        }
+        return taps;
+    }
+
+    // separable: rows first into a temporary image, then columns
+    static FloatImage resize(const FloatImage &image, int newWidth, int newHeight)
+    {
+        Taps horizontal = computeTaps(image.width, newWidth), vertical = computeTaps(image.height, newHeight);
+
+        FloatImage rows;
+        rows.width = newWidth;
+        rows.height = image.height;
+        rows.pixels.resize((size_t)newWidth * image.height * 4);
+        GetThreadPool().parallelFor(0, image.height, [&](int first, int last)
+                                    {
+                                        for (int y = first; y < last; y++)
+                                        {
+                                            const float *in = &image.pixels[(size_t)y * image.width * 4];
+                                            float *out = &rows.pixels[(size_t)y * newWidth * 4];
+                                            for (int x = 0; x < newWidth; x++)
+                                            {
+                                                Float4 sum = Float4::zero();
+                                                for (int t = horizontal.offsets[x]; t < horizontal.offsets[x + 1]; t++)
+                                                    sum.addScaled(Float4::load(in + 4 * horizontal.sources[t]), horizontal.weights[t]);
+                                                sum.store(out + 4 * x);
+                                            }
+                                        }
+                                    },
+                                    ROWS_PER_SLICE);
+
+        FloatImage result;
+        result.width = newWidth;
+        result.height = newHeight;
+        result.pixels.resize((size_t)newWidth * newHeight * 4);
+        GetThreadPool().parallelFor(0, newHeight, [&](int first, int last)
+                                    {
+                                        for (int y = first; y < last; y++)
+                                        {
+                                            float *out = &result.pixels[(size_t)y * newWidth * 4]; // starts out as zeros
+                                            // whole source rows at a time, which reads memory in order
+                                            for (int t = vertical.offsets[y]; t < vertical.offsets[y + 1]; t++)
+                                            {
+                                                const float *in = &rows.pixels[(size_t)vertical.sources[t] * newWidth * 4];
+                                                float weight = vertical.weights[t];
+                                                for (int x = 0; x < newWidth; x++)
+                                                {
+                                                    Float4 sum = Float4::load(out + 4 * x);
+                                                    sum.addScaled(Float4::load(in + 4 * x), weight);
+                                                    sum.store(out + 4 * x);
+                                                }
+                                            }
+                                        }
+                                    },
+                                    ROWS_PER_SLICE);
+        return result;
+    }
+};
+#endif
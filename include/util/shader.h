@@ -4,10 +4,112 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <util/programcache.h>
+
+#include <chrono>
+#include <filesystem>
+#include <map>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// binding points of the uniform blocks every program can declare (std140 layout):
+//   FrameUniforms: per-frame constants shared across all programs, see struct FrameUniforms
+//   DrawUniforms:  per-draw data such as the model and normal matrix, filled from a UniformRing
+// GLSL 3.30 has no layout(binding = ...) for blocks, so the Shader class assigns these after linking.
+constexpr GLuint FRAME_UNIFORMS_BINDING = 0;
+constexpr GLuint DRAW_UNIFORMS_BINDING = 1;
+
+// std140 mirror of the FrameUniforms block:
+//   layout (std140) uniform FrameUniforms { mat4 projection; mat4 view; vec4 cameraPos; vec4 lightPos; vec2 mousePos; float time; };
+struct FrameUniforms
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 cameraPos; // vec3 members would be padded to 16 bytes anyway
+    glm::vec4 lightPos;
+    glm::vec2 mousePos;
+    float time;
+    float pad;
+};
+
+// std140 mirror of the start of a DrawUniforms block; programs append their own members after these:
+//   layout (std140) uniform DrawUniforms { mat4 model; mat4 normalMatrix; vec4 positionScale; vec4 positionOffset; ... };
+// the normal matrix is stored as a mat4 since a std140 mat3 is padded to three vec4 columns, use mat3(normalMatrix).
+// The vertex shader takes the object space position as aPos * positionScale.xyz + positionOffset.xyz, which maps the
+// quantized positions of a mesh back (see Mesh::positionScale()) without touching the model and normal matrix.
+struct DrawUniforms
+{
+    glm::mat4 model;
+    glm::mat4 normalMatrix;
+    glm::vec4 positionScale = glm::vec4(1.0f); // vec3 members would be padded to 16 bytes anyway
+    glm::vec4 positionOffset = glm::vec4(0.0f);
+
+    DrawUniforms(const glm::mat4 &model = glm::mat4(1.0f))
+        : model(model), normalMatrix(glm::mat4(glm::transpose(glm::inverse(glm::mat3(model)))))
+    {
+    }
+};
+
+// A uniform name reduced to its FNV-1a hash, which is all the Shader needs to find the uniform.
+// Hashing is constexpr, so names can be hashed at compile time: constexpr UniformId LIGHT_POS("lightPos");
+struct UniformId
+{
+    std::uint32_t hash;
+
+    constexpr UniformId(const char *name) : hash(hashName(name)) {}
+    UniformId(const std::string &name) : hash(hashName(name.c_str())) {}
+
+    static constexpr std::uint32_t hashName(const char *name)
+    {
+        std::uint32_t hash = 2166136261u;
+        while (*name)
+            hash = (hash ^ (unsigned char)*name++) * 16777619u;
+        return hash;
+    }
+};
+
+// glUniform* calls that were issued, skipped because the uniform already had the value, or dropped because the
+// program has no such active uniform; summed over all shaders
+struct UniformCounters
+{
+    size_t uploads = 0;
+    size_t skipped = 0;
+    size_t unknown = 0;
+};
+
+UniformCounters &GetUniformCounters()
+{
+    static UniformCounters counters;
+    return counters;
+}
+
+// where #include "file" looks for files that are not next to the including file, e.g. code shared by several apps;
+// relative to the working directory, like the paths of the shader files
+constexpr const char *SHADER_INCLUDE_DIRECTORY = "../resources/shaders";
+
+// preprocessor defines a program is specialized with, name -> value (may be empty)
+using ShaderDefines = std::map<std::string, std::string>;
+
+// a float as a GLSL literal for a define, e.g. 3 -> "3.0" and 0.1 -> "0.1" (std::to_string would give "3.000000")
+inline std::string ShaderFloat(float value)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", value);
+    std::string literal = text;
+    if (literal.find_first_of(".eEn") == std::string::npos) // n: inf and nan aren't literals anyway
+        literal += ".0";
+    return literal;
+}
 
 class Shader
 {
@@ -16,6 +118,37 @@ private:
     std::string fPath = "";
     std::string gPath = "";
     bool isSuccess = false;
+    ShaderDefines defines;
+    std::vector<std::string> includedPaths; // files pulled in with #include by the last load, source string i + 1
+
+    // an active uniform of the linked program and a shadow copy of the last value uploaded to it
+    struct UniformSlot
+    {
+        GLint location;
+        GLenum type;
+        bool known = false;
+        unsigned char value[sizeof(float) * 16]; // large enough for a mat4
+    };
+    struct IdentityHash
+    {
+        size_t operator()(std::uint32_t hash) const { return hash; }
+    };
+    using UniformTable = std::unordered_map<std::uint32_t, UniformSlot, IdentityHash>;
+    std::shared_ptr<UniformTable> uniforms; // replaced when the program is relinked
+
+    // a program whose compilation has been started but not checked yet, see beginLoad()/finishLoad()
+    struct PendingProgram
+    {
+        GLuint program = 0;
+        std::vector<GLuint> stages; // empty if the program was loaded from the program cache
+        std::vector<std::string> stageTypes;
+        std::uint64_t cacheKey = 0;
+        bool fromCache = false;
+        std::chrono::high_resolution_clock::time_point start;
+    };
+    float loadMs = 0.0f;
+    bool loadedFromCache = false;
+    std::shared_ptr<PendingProgram> pendingReload; // a reload running in the background, see startReload()
 
 public:
     // check if the shader program is ready: all shaders have been loaded compiled and linked
@@ -31,11 +164,13 @@ public:
 
         return ID;
     }
-    unsigned int ID; // shader program id
+    unsigned int ID = 0; // shader program id
 
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char *vertexPath, const char *fragmentPath, const char *geometryPath = nullptr)
+    // pass compileNow = false to compile later with LoadAll(), which lets the driver work on several programs at once
+    // ------------------------------------------------------------------------
+    Shader(const char *vertexPath, const char *fragmentPath, const char *geometryPath = nullptr, bool compileNow = true)
     {
         if (vertexPath)
             vPath = std::string(vertexPath);
@@ -44,7 +179,25 @@ public:
         if (geometryPath)
             gPath = std::string(geometryPath);
 
+        ID = 0;
+        if (!compileNow)
+            return;
+        isSuccess = loadAndCompile(vPath, fPath, gPath, ID);
+        uniforms = reflectUniforms(ID);
+    }
+
+    // constructor generates the shader on the fly
+    // ------------------------------------------------------------------------
+    // constructor for a variant specialized with defines, which are inserted after the #version line of every stage
+    // ------------------------------------------------------------------------
+    Shader(const char *vertexPath, const char *fragmentPath, const char *geometryPath, const ShaderDefines &defines, bool compileNow = true)
+        : Shader(vertexPath, fragmentPath, geometryPath, false)
+    {
+        this->defines = defines;
+        if (!compileNow)
+            return;
         isSuccess = loadAndCompile(vPath, fPath, gPath, ID);
+        uniforms = reflectUniforms(ID);
     }
 
     // constructor generates the shader on the fly
@@ -54,6 +207,7 @@ public:
         vPath = vertexPath;
         fPath = fragmentPath;
         isSuccess = loadAndCompile(vPath, fPath, gPath, ID);
+        uniforms = reflectUniforms(ID);
     }
 
     // constructor generates the shader on the fly
@@ -64,24 +218,164 @@ public:
         fPath = fragmentPath;
         gPath = geometryPath;
         isSuccess = loadAndCompile(vPath, fPath, gPath, ID);
+        uniforms = reflectUniforms(ID);
+    }
+
+    // a shader owns its program: it can be moved but not copied, the program is deleted with the shader
+    // ------------------------------------------------------------------------
+    Shader(const Shader &) = delete;
+    Shader &operator=(const Shader &) = delete;
+
+    Shader(Shader &&other) noexcept { *this = std::move(other); }
+
+    Shader &operator=(Shader &&other) noexcept
+    {
+        if (this == &other)
+            return *this;
+        deleteProgram();
+        vPath = std::move(other.vPath);
+        fPath = std::move(other.fPath);
+        gPath = std::move(other.gPath);
+        isSuccess = other.isSuccess;
+        defines = std::move(other.defines);
+        includedPaths = std::move(other.includedPaths);
+        uniforms = std::move(other.uniforms);
+        loadMs = other.loadMs;
+        loadedFromCache = other.loadedFromCache;
+        pendingReload = std::move(other.pendingReload);
+        ID = other.ID;
+        other.ID = 0;
+        other.isSuccess = false;
+        return *this;
     }
 
+    ~Shader() { deleteProgram(); }
+
     // try to reload and recompile the shder
     // ------------------------------------------------------------------------
     void reload()
     {
-        unsigned int newID;
-        if (loadAndCompile(vPath, fPath, gPath, newID))
+        LoadAll({this});
+    }
+
+    // (re)loads several shaders at once: every compile and link is issued before the first status is queried, so a
+    // driver with parallel shader compilation works on all of them concurrently; shaders that fail keep their program
+    // ------------------------------------------------------------------------
+    static void LoadAll(const std::vector<Shader *> &shaders)
+    {
+        std::vector<PendingProgram> pending(shaders.size());
+        std::vector<bool> started(shaders.size());
+        for (size_t i = 0; i < shaders.size(); i++)
+            started[i] = shaders[i]->beginLoad(pending[i]);
+
+        // with parallel compilation, finish the programs in the order they complete instead of waiting on the first
+        size_t remaining = shaders.size();
+        while (remaining > 0)
         {
-            ID = newID;
-            isSuccess = true;
+            for (size_t i = 0; i < shaders.size(); i++)
+            {
+                if (!started[i])
+                {
+                    if (shaders[i]->isSuccess)
+                        std::cout << "ERROR::SHADER_RELOAD_ERROR : keeping previous shader!" << std::endl;
+                    started[i] = true;
+                    pending[i].program = 0;
+                    remaining--;
+                    continue;
+                }
+                if (pending[i].program == 0 || !isComplete(pending[i]))
+                    continue;
+
+                Shader &shader = *shaders[i];
+                if (shader.finishLoad(pending[i]))
+                {
+                    shader.swapProgram(pending[i].program);
+                }
+                else if (shader.isSuccess)
+                {
+                    std::cout << "ERROR::SHADER_RELOAD_ERROR : keeping previous shader!" << std::endl;
+                }
+                pending[i].program = 0;
+                remaining--;
+            }
+            if (remaining > 0)
+                std::this_thread::yield();
         }
-        else
+    }
+
+    // starts recompiling in the background; the new program replaces the current one in a later pollReload() once it
+    // has linked successfully, until then (and if it fails) the current program stays in use
+    // ------------------------------------------------------------------------
+    bool startReload()
+    {
+        if (pendingReload)
+            return false;
+        auto pending = std::make_shared<PendingProgram>();
+        if (!beginLoad(*pending))
         {
             std::cout << "ERROR::SHADER_RELOAD_ERROR : keeping previous shader!" << std::endl;
+            return false;
         }
+        pendingReload = pending;
+        return true;
     }
 
+    bool isReloading() const { return pendingReload != nullptr; }
+
+    // call once per frame, never blocks while the driver is still compiling; returns true if the program was replaced,
+    // then the shader has to be used again and plain uniforms have to be set again
+    // ------------------------------------------------------------------------
+    bool pollReload()
+    {
+        DeleteRetiredPrograms();
+        if (!pendingReload || !isComplete(*pendingReload))
+            return false;
+        auto pending = std::move(pendingReload);
+        if (!finishLoad(*pending))
+        {
+            std::cout << "ERROR::SHADER_RELOAD_ERROR : keeping previous shader!" << std::endl;
+            return false;
+        }
+        swapProgram(pending->program);
+        return true;
+    }
+
+    // the source files of all stages, e.g. to watch them for changes
+    // ------------------------------------------------------------------------
+    std::vector<std::string> getSourcePaths() const
+    {
+        std::vector<std::string> paths;
+        for (const std::string &path : {vPath, fPath, gPath})
+            if (!path.empty())
+                paths.push_back(path);
+        paths.insert(paths.end(), includedPaths.begin(), includedPaths.end());
+        return paths;
+    }
+
+    // deletes replaced programs once the GPU has finished all commands issued before the replacement
+    // ------------------------------------------------------------------------
+    static void DeleteRetiredPrograms()
+    {
+        auto &retired = retiredPrograms();
+        for (size_t i = 0; i < retired.size();)
+        {
+            if (glClientWaitSync(retired[i].second, 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                i++;
+                continue;
+            }
+            glDeleteSync(retired[i].second);
+            glDeleteProgram(retired[i].first);
+            retired[i] = retired.back();
+            retired.pop_back();
+        }
+    }
+
+    // time the last (re)load took and whether the program came from the program cache
+    // ------------------------------------------------------------------------
+    float getLoadMs() const { return loadMs; }
+    bool isFromCache() const { return loadedFromCache; }
+
     // activate the shader
     // ------------------------------------------------------------------------
     void use()
@@ -89,65 +383,199 @@ public:
         glUseProgram(ID);
     }
     // utility uniform functions
+    // the names are looked up in the table of active uniforms built at link time and nothing is uploaded if the
+    // uniform already holds the value; as with glUniform*, the shader has to be in use
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    void setBool(UniformId name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        setInt(name, (int)value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(UniformId name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        if (const UniformSlot *slot = changed(name, &value, sizeof(value)))
+            glUniform1i(slot->location, value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setFloat(UniformId name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        if (const UniformSlot *slot = changed(name, &value, sizeof(value)))
+            glUniform1f(slot->location, value);
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setVec2(UniformId name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        if (const UniformSlot *slot = changed(name, &value[0], 2 * sizeof(float)))
+            glUniform2fv(slot->location, 1, &value[0]);
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setVec2(UniformId name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        setVec2(name, glm::vec2(x, y));
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setVec3(UniformId name, const glm::vec3 &value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        if (const UniformSlot *slot = changed(name, &value[0], 3 * sizeof(float)))
+            glUniform3fv(slot->location, 1, &value[0]);
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setVec3(UniformId name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        setVec3(name, glm::vec3(x, y, z));
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec4(UniformId name, const glm::vec4 &value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        if (const UniformSlot *slot = changed(name, &value[0], 4 * sizeof(float)))
+            glUniform4fv(slot->location, 1, &value[0]);
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w)
+    void setVec4(UniformId name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        setVec4(name, glm::vec4(x, y, z, w));
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat2(UniformId name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        if (const UniformSlot *slot = changed(name, &mat[0][0], 4 * sizeof(float)))
+            glUniformMatrix2fv(slot->location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat3(UniformId name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        if (const UniformSlot *slot = changed(name, &mat[0][0], 9 * sizeof(float)))
+            glUniformMatrix3fv(slot->location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat4(UniformId name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        if (const UniformSlot *slot = changed(name, &mat[0][0], 16 * sizeof(float)))
+            glUniformMatrix4fv(slot->location, 1, GL_FALSE, &mat[0][0]);
+    }
+
+    // location of an active uniform, -1 if the program has none of that name
+    // ------------------------------------------------------------------------
+    GLint getUniformLocation(UniformId name) const
+    {
+        if (!uniforms)
+            return -1;
+        auto it = uniforms->find(name.hash);
+        return it != uniforms->end() ? it->second.location : -1;
+    }
+
+    // connect a uniform block of the program to a binding point, returns false if the program has no such block
+    // ------------------------------------------------------------------------
+    bool bindUniformBlock(const std::string &name, GLuint binding) const
+    {
+        return bindUniformBlock(ID, name, binding);
     }
 
 private:
+    // programs that were replaced and the fence after which the GPU no longer reads them
+    static std::vector<std::pair<GLuint, GLsync>> &retiredPrograms()
+    {
+        static std::vector<std::pair<GLuint, GLsync>> retired;
+        return retired;
+    }
+
+    // deletes the program and a reload that is still running
+    void deleteProgram()
+    {
+        if (pendingReload && pendingReload->program != 0)
+        {
+            for (GLuint stage : pendingReload->stages)
+                glDeleteShader(stage);
+            glDeleteProgram(pendingReload->program);
+        }
+        pendingReload.reset();
+        if (ID != 0)
+            glDeleteProgram(ID);
+        ID = 0;
+        isSuccess = false;
+    }
+
+    // makes a successfully linked program the current one; the previous one is deleted once it is no longer in use
+    void swapProgram(GLuint program)
+    {
+        if (isSuccess && ID != 0 && ID != program)
+            retiredPrograms().push_back({ID, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+        ID = program;
+        isSuccess = true;
+        uniforms = reflectUniforms(ID);
+    }
+
+    // returns the slot to upload to if the value differs from the last upload, and records it as uploaded
+    const UniformSlot *changed(UniformId name, const void *value, size_t size) const
+    {
+        UniformCounters &counters = GetUniformCounters();
+        UniformTable::iterator it;
+        if (!uniforms || (it = uniforms->find(name.hash)) == uniforms->end())
+        {
+            counters.unknown++;
+            return nullptr;
+        }
+        UniformSlot &slot = it->second;
+        if (slot.known && std::memcmp(slot.value, value, size) == 0)
+        {
+            counters.skipped++;
+            return nullptr;
+        }
+        std::memcpy(slot.value, value, size);
+        slot.known = true;
+        counters.uploads++;
+        return &slot;
+    }
+
+    // builds the table of active uniforms; arrays are entered by their plain name and by every element name[i]
+    static std::shared_ptr<UniformTable> reflectUniforms(GLuint program)
+    {
+        auto table = std::make_shared<UniformTable>();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength + 1);
+
+        auto addSlot = [&](const std::string &name, GLenum type)
+        {
+            UniformSlot slot;
+            slot.location = glGetUniformLocation(program, name.c_str());
+            slot.type = type;
+            if (slot.location < 0)
+                return; // a member of a uniform block
+            auto inserted = table->emplace(UniformId(name).hash, slot);
+            if (!inserted.second && inserted.first->second.location != slot.location)
+                std::cout << "ERROR::SHADER_UNIFORM : hash collision for uniform " << name << "!" << std::endl;
+        };
+
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(program, (GLuint)i, (GLsizei)buffer.size(), nullptr, &size, &type, buffer.data());
+            std::string name(buffer.data());
+            size_t bracket = name.rfind("[0]");
+            if (bracket != std::string::npos && bracket + 3 == name.size())
+            {
+                std::string base = name.substr(0, bracket);
+                addSlot(base, type);
+                for (GLint element = 0; element < size; element++)
+                    addSlot(base + "[" + std::to_string(element) + "]", type);
+            }
+            else
+            {
+                addSlot(name, type);
+            }
+        }
+        return table;
+    }
+
+    static bool bindUniformBlock(GLuint program, const std::string &name, GLuint binding)
+    {
+        GLuint index = glGetUniformBlockIndex(program, name.c_str());
+        if (index == GL_INVALID_INDEX)
+            return false;
+        glUniformBlockBinding(program, index, binding);
+        return true;
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     bool checkCompileErrors(GLuint shader, std::string type)
@@ -180,7 +608,23 @@ private:
 
     bool loadAndCompile(std::string vertexPath, std::string fragmentPath, std::string geometryPath, unsigned int &ID)
     {
-        bool success = true;
+        PendingProgram pending;
+        if (!beginLoad(pending, vertexPath, fragmentPath, geometryPath))
+            return false;
+        bool success = finishLoad(pending);
+        ID = pending.program;
+        return success;
+    }
+
+    bool beginLoad(PendingProgram &pending)
+    {
+        return beginLoad(pending, vPath, fPath, gPath);
+    }
+
+    // reads the sources and either loads the program from the program cache or starts compiling and linking it
+    bool beginLoad(PendingProgram &pending, const std::string &vertexPath, const std::string &fragmentPath, const std::string &geometryPath)
+    {
+        pending.start = std::chrono::high_resolution_clock::now();
 
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -223,45 +667,474 @@ private:
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
             return false;
         }
-        const char *vShaderCode = vertexCode.c_str();
-        const char *fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        success = success && checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        success = success && checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
+
+        // resolve #include and add the defines; the program cache key below covers the result
+        includedPaths.clear();
+        if (!preprocess(vertexCode, vertexPath) || !preprocess(fragmentCode, fragmentPath) ||
+            (!geometryPath.empty() && !preprocess(geometryCode, geometryPath)))
+            return false;
+
+        // 2. try the program cache
+        pending.program = glCreateProgram();
+        pending.cacheKey = ProgramCache::key({vertexCode, fragmentCode, geometryCode});
+        pending.fromCache = ProgramCache::load(pending.program, pending.cacheKey);
+        if (pending.fromCache)
+            return true;
+
+        // 3. compile shaders, the results are checked in finishLoad()
+        auto compile = [&pending](GLenum type, const char *typeName, const std::string &code)
+        {
+            const char *source = code.c_str();
+            GLuint shader = glCreateShader(type);
+            glShaderSource(shader, 1, &source, NULL);
+            glCompileShader(shader);
+            glAttachShader(pending.program, shader);
+            pending.stages.push_back(shader);
+            pending.stageTypes.push_back(typeName);
+        };
+        compile(GL_VERTEX_SHADER, "VERTEX", vertexCode);
+        compile(GL_FRAGMENT_SHADER, "FRAGMENT", fragmentCode);
         if (!geometryPath.empty())
+            compile(GL_GEOMETRY_SHADER, "GEOMETRY", geometryCode);
+        // shader Program
+        ProgramCache::prepareForStore(pending.program);
+        glLinkProgram(pending.program);
+        return true;
+    }
+
+    // expands #include "file" (relative to the including file, else to SHADER_INCLUDE_DIRECTORY) and inserts the defines
+    // after the #version line.
+    // #line directives keep the line numbers of error messages right, included files get their own source string.
+    bool preprocess(std::string &code, const std::string &path)
+    {
+        std::string expanded;
+        std::vector<std::string> stack = {std::filesystem::path(path).lexically_normal().string()};
+        if (!expandIncludes(code, stack, 0, expanded))
+            return false;
+
+        std::string header;
+        for (const auto &define : defines)
+            header += "#define " + define.first + " " + define.second + "\n";
+        // #version has to stay the first statement
+        size_t bodyStart = 0;
+        size_t version = expanded.find("#version");
+        if (version != std::string::npos)
+            bodyStart = expanded.find('\n', version) + 1;
+        int bodyLine = 1 + (int)std::count(expanded.begin(), expanded.begin() + bodyStart, '\n');
+        code = expanded.substr(0, bodyStart) + header + "#line " + std::to_string(bodyLine) + "\n" + expanded.substr(bodyStart);
+        return true;
+    }
+
+    bool expandIncludes(const std::string &code, std::vector<std::string> &stack, int sourceString, std::string &expanded)
+    {
+        std::istringstream lines(code);
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(lines, line))
         {
-            const char *gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            success = success && checkCompileErrors(geometry, "GEOMETRY");
+            lineNumber++;
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+            {
+                expanded += line + "\n";
+                continue;
+            }
+
+            size_t open = line.find('"', start), close = line.find('"', open + 1);
+            if (open == std::string::npos || close == std::string::npos)
+            {
+                std::cout << "ERROR::SHADER::INCLUDE : malformed include in " << stack.back() << "(" << lineNumber << ")" << std::endl;
+                return false;
+            }
+            std::string name = line.substr(open + 1, close - open - 1);
+            std::filesystem::path directory = std::filesystem::path(stack.back()).parent_path();
+            std::string includePath = (directory / name).lexically_normal().string();
+            if (!std::filesystem::exists(includePath))
+                includePath = (std::filesystem::path(SHADER_INCLUDE_DIRECTORY) / name).lexically_normal().string();
+            if (std::find(stack.begin(), stack.end(), includePath) != stack.end())
+            {
+                std::cout << "ERROR::SHADER::INCLUDE : " << includePath << " includes itself" << std::endl;
+                return false;
+            }
+
+            std::ifstream file(includePath);
+            if (!file)
+            {
+                std::cout << "ERROR::SHADER::INCLUDE : could not read " << includePath << std::endl;
+                return false;
+            }
+            std::stringstream content;
+            content << file.rdbuf();
+
+            auto known = std::find(includedPaths.begin(), includedPaths.end(), includePath);
+            int includeString = (int)(known - includedPaths.begin()) + 1;
+            if (known == includedPaths.end())
+                includedPaths.push_back(includePath);
+
+            expanded += "#line 1 " + std::to_string(includeString) + "\n";
+            stack.push_back(includePath);
+            if (!expandIncludes(content.str(), stack, includeString, expanded))
+                return false;
+            stack.pop_back();
+            expanded += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceString) + "\n";
         }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if (!geometryPath.empty())
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        success = success && checkCompileErrors(ID, "PROGRAM");
+        return true;
+    }
+
+    // true once the driver has finished linking; always true without parallel shader compilation, where querying
+    // the status simply waits for the link
+    static bool isComplete(const PendingProgram &pending)
+    {
+        if (pending.fromCache || !ProgramCache::hasParallelCompile())
+            return true;
+        GLint complete = GL_FALSE;
+        glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &complete);
+        return complete == GL_TRUE;
+    }
+
+    // checks the compile and link results, stores new binaries in the program cache and reports the load time
+    bool finishLoad(PendingProgram &pending)
+    {
+        bool success = true;
+        for (size_t i = 0; i < pending.stages.size(); i++)
+            success = checkCompileErrors(pending.stages[i], pending.stageTypes[i]) && success;
+        if (!pending.fromCache)
+            success = success && checkCompileErrors(pending.program, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if (!geometryPath.empty())
-            glDeleteShader(geometry);
+        for (GLuint shader : pending.stages)
+            glDeleteShader(shader);
+        pending.stages.clear();
 
-        return success;
+        if (!success)
+        {
+            // the error messages refer to included files by their source string number
+            for (size_t i = 0; i < includedPaths.size(); i++)
+                std::cout << "source string " << (i + 1) << ": " << includedPaths[i] << std::endl;
+            glDeleteProgram(pending.program);
+            pending.program = 0;
+            return false;
+        }
+        if (!pending.fromCache)
+            ProgramCache::store(pending.program, pending.cacheKey);
+
+        // connect the standard uniform blocks to their binding points
+        bindUniformBlock(pending.program, "FrameUniforms", FRAME_UNIFORMS_BINDING);
+        bindUniformBlock(pending.program, "DrawUniforms", DRAW_UNIFORMS_BINDING);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        loadMs = std::chrono::duration_cast<std::chrono::microseconds>(end - pending.start).count() / 1000.0f;
+        loadedFromCache = pending.fromCache;
+        std::cout << "Loading Shader " << vPath << " ... done (in " << loadMs << " milliseconds, "
+                  << (loadedFromCache ? "from the program cache" : "compiled") << ")." << std::endl;
+        return true;
+    }
+};
+
+// The variants of one set of shader files, each specialized with its own defines (e.g. a feature switched on or a
+// constant baked in) instead of branching on uniforms. A variant is compiled the first time it is requested; the
+// variants are kept, so switching back and forth costs nothing after that. A variant that failed to compile is
+// compiled again once one of its shader files changed.
+class ShaderVariants
+{
+public:
+    ShaderVariants(const std::string &vertexPath, const std::string &fragmentPath, const std::string &geometryPath = "", const ShaderDefines &common = {})
+        : vPath(vertexPath), fPath(fragmentPath), gPath(geometryPath), common(common)
+    {
+    }
+
+    ShaderVariants(const ShaderVariants &) = delete;
+    ShaderVariants &operator=(const ShaderVariants &) = delete;
+
+    // the variant for the given defines (in addition to the common ones), compiled on first use
+    // ------------------------------------------------------------------------
+    Shader &get(const ShaderDefines &defines = {})
+    {
+        std::uint64_t key = permutationKey(defines);
+        auto it = variants.find(key);
+        if (it != variants.end() && (it->second->isReady() || newestSourceTime() <= failures[key]))
+            return *it->second;
+        prepare({defines});
+        return *variants[key];
+    }
+
+    // compiles several variants at once ahead of their first use, see Shader::LoadAll
+    // ------------------------------------------------------------------------
+    void prepare(const std::vector<ShaderDefines> &permutations)
+    {
+        std::vector<Shader *> created;
+        std::vector<std::uint64_t> keys;
+        for (const ShaderDefines &defines : permutations)
+        {
+            std::uint64_t key = permutationKey(defines);
+            auto it = variants.find(key);
+            if (it != variants.end())
+            {
+                if (!it->second->isReady()) // compiled again in place
+                {
+                    created.push_back(it->second.get());
+                    keys.push_back(key);
+                }
+                continue;
+            }
+            ShaderDefines all = common;
+            for (const auto &define : defines)
+                all[define.first] = define.second;
+            auto shader = std::make_unique<Shader>(vPath.c_str(), fPath.c_str(), gPath.empty() ? nullptr : gPath.c_str(), all, false);
+            created.push_back(shader.get());
+            keys.push_back(key);
+            variants[key] = std::move(shader);
+        }
+        if (created.empty())
+            return;
+        std::filesystem::file_time_type attempt = newestSourceTime();
+        Shader::LoadAll(created);
+        for (size_t i = 0; i < created.size(); i++)
+        {
+            if (created[i]->isReady())
+                failures.erase(keys[i]);
+            else
+                failures[keys[i]] = attempt;
+        }
+    }
+
+    // all variants compiled so far
+    // ------------------------------------------------------------------------
+    std::vector<Shader *> all() const
+    {
+        std::vector<Shader *> shaders;
+        for (const auto &variant : variants)
+            shaders.push_back(variant.second.get());
+        return shaders;
+    }
+
+    size_t size() const { return variants.size(); }
+
+private:
+    std::string vPath, fPath, gPath;
+    ShaderDefines common;
+    std::unordered_map<std::uint64_t, std::unique_ptr<Shader>> variants;
+    std::unordered_map<std::uint64_t, std::filesystem::file_time_type> failures; // newest file time at the failed compile
+
+    // the last change to one of the shader files (files pulled in with #include are left to the ShaderWatcher)
+    std::filesystem::file_time_type newestSourceTime() const
+    {
+        std::filesystem::file_time_type newest = std::filesystem::file_time_type::min();
+        for (const std::string *path : {&vPath, &fPath, &gPath})
+        {
+            std::error_code error;
+            if (path->empty())
+                continue;
+            std::filesystem::file_time_type time = std::filesystem::last_write_time(*path, error);
+            if (!error)
+                newest = std::max(newest, time);
+        }
+        return newest;
+    }
+
+    // FNV-1a over the sorted name=value pairs
+    static std::uint64_t permutationKey(const ShaderDefines &defines)
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const auto &define : defines)
+            for (const std::string *text : {&define.first, &define.second})
+            {
+                for (char c : *text)
+                    hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+                hash = (hash ^ 0xff) * 1099511628211ull;
+            }
+        return hash;
+    }
+};
+
+// A uniform buffer that is bound to a fixed binding point and rewritten as a whole, e.g. once per frame.
+class UniformBuffer
+{
+public:
+    UniformBuffer(GLuint binding, GLsizeiptr size) : binding(binding), size(size)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    }
+
+    ~UniformBuffer() { glDeleteBuffers(1, &buffer); }
+
+    UniformBuffer(const UniformBuffer &) = delete;
+    UniformBuffer &operator=(const UniformBuffer &) = delete;
+
+    // upload new contents, the struct has to follow the std140 layout of the block
+    // ------------------------------------------------------------------------
+    template <class T>
+    void update(const T &data)
+    {
+        static_assert(sizeof(T) > 0, "empty uniform block");
+        if ((GLsizeiptr)sizeof(T) > size)
+        {
+            std::cout << "ERROR::UNIFORM_BUFFER : block of " << sizeof(T) << " bytes does not fit into " << size << " bytes!" << std::endl;
+            return;
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW); // orphan, so the previous frame can still read the old contents
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    }
+
+private:
+    GLuint buffer = 0;
+    GLuint binding;
+    GLsizeiptr size;
+};
+
+// A ring of per-draw uniform blocks. The buffer is split into one region per frame in flight (three by default). The
+// blocks of a frame are staged in a CPU array first: stage() copies a block there and returns its index, upload()
+// writes everything staged since the last upload into the region of the frame with one mapping, and bind() points the
+// binding at a block with glBindBufferRange. Staging all blocks of a pass before its draws keeps it to one upload per
+// pass instead of one per draw. A fence per region guarantees that a region is only overwritten once the GPU has
+// finished the frame that read from it; a frame that stages more blocks than fit grows the ring.
+class UniformRing
+{
+public:
+    UniformRing(GLuint binding, GLsizeiptr blockSize, int blocksPerFrame, int frames = 3)
+        : binding(binding), blockSize(blockSize), fences(frames, nullptr)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (blockSize + alignment - 1) / alignment * alignment;
+        regionSize = stride * std::max(blocksPerFrame, 1);
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, regionSize * frames, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    ~UniformRing()
+    {
+        for (GLsync fence : fences)
+            if (fence)
+                glDeleteSync(fence);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    UniformRing(const UniformRing &) = delete;
+    UniformRing &operator=(const UniformRing &) = delete;
+
+    // number of blocks staged in the current frame, frames that had to wait for the GPU and times the ring grew
+    int stagedBlocks() const { return staged; }
+    int stalledFrames() const { return stalls; }
+    int growths() const { return grown; }
+
+    // move on to the next region, waiting for the GPU if it still reads from it
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        region = (region + 1) % (int)fences.size();
+        staged = 0;
+        uploaded = 0;
+        GLsync &fence = fences[region];
+        if (!fence)
+            return;
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            stalls++;
+            while ((result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000)) == GL_TIMEOUT_EXPIRED)
+                ;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    // the region of this frame may be reused once the GPU has passed this point
+    // ------------------------------------------------------------------------
+    void endFrame()
+    {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // copies a block into the staging array; returns its index for bind(), or -1 if the block is larger than the ring's
+    // ------------------------------------------------------------------------
+    template <class T>
+    int stage(const T &data)
+    {
+        if ((GLsizeiptr)sizeof(T) > blockSize)
+        {
+            if (!reportedSize)
+                std::cout << "ERROR::UNIFORM_RING : a block of " << sizeof(T) << " bytes does not fit into the blocks of " << blockSize
+                          << " bytes, it is not drawn with!" << std::endl;
+            reportedSize = true;
+            return -1;
+        }
+        size_t end = (size_t)(staged + 1) * stride;
+        if (staging.size() < end)
+            staging.resize(end);
+        std::memcpy(staging.data() + (size_t)staged * stride, &data, sizeof(T));
+        return staged++;
+    }
+
+    // writes the blocks staged since the last upload into the region of this frame, growing the ring if they don't fit
+    // ------------------------------------------------------------------------
+    void upload()
+    {
+        if (uploaded == staged)
+            return;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        if ((GLsizeiptr)staged * stride > regionSize)
+            grow();
+        GLintptr offset = region * regionSize + (GLintptr)uploaded * stride;
+        GLsizeiptr size = (GLsizeiptr)(staged - uploaded) * stride;
+        // the fence of this region has been waited for, so the driver doesn't need to synchronize
+        void *target = glMapBufferRange(GL_UNIFORM_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (target)
+        {
+            std::memcpy(target, staging.data() + (size_t)uploaded * stride, size);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        uploaded = staged;
+    }
+
+    // binds an uploaded block for the following draw calls
+    // ------------------------------------------------------------------------
+    void bind(int block) const
+    {
+        if (block >= 0 && block < uploaded)
+            glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, region * regionSize + (GLintptr)block * stride, blockSize);
+    }
+
+private:
+    GLuint buffer = 0;
+    GLuint binding;
+    GLsizeiptr blockSize, stride, regionSize;
+    int staged = 0;   // blocks in the staging array this frame
+    int uploaded = 0; // of those, the ones in the buffer
+    int region = 0;
+    int stalls = 0;
+    int grown = 0;
+    bool reportedSize = false;
+    std::vector<unsigned char> staging;
+    std::vector<GLsync> fences;
+
+    // doubles the regions until the frame fits; the old storage is orphaned, the GPU keeps reading the draws issued
+    // with it, so the fences are dropped and this frame's blocks are uploaded again from the start. Expects the buffer
+    // to be bound.
+    void grow()
+    {
+        while ((GLsizeiptr)staged * stride > regionSize)
+            regionSize *= 2;
+        glBufferData(GL_UNIFORM_BUFFER, regionSize * (GLsizeiptr)fences.size(), nullptr, GL_DYNAMIC_DRAW);
+        for (GLsync &fence : fences)
+            if (fence)
+            {
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        uploaded = 0;
+        std::cout << "UNIFORM_RING : grown to " << regionSize / stride << " blocks per frame" << std::endl;
+        grown++;
     }
 };
 #endif
@@ -0,0 +1,192 @@
+#ifndef SHADERWATCHER_H
+#define SHADERWATCHER_H
+
+#include <util/shader.h>
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Watches the source files of shaders and reloads a shader when one of them changes, without blocking the frame:
+// the new program compiles in the background (see Shader::startReload) and replaces the old one once it linked.
+// On Linux the directories of the sources are watched with inotify, elsewhere the modification times are polled.
+class ShaderWatcher
+{
+public:
+    ShaderWatcher()
+    {
+#ifdef __linux__
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd < 0)
+            std::cout << "WARNING::SHADER_WATCHER : inotify is not available, polling instead" << std::endl;
+#endif
+    }
+
+    ~ShaderWatcher()
+    {
+#ifdef __linux__
+        if (inotifyFd >= 0)
+            close(inotifyFd);
+#endif
+    }
+
+    ShaderWatcher(const ShaderWatcher &) = delete;
+    ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+    // watch all source files of a shader, the shader has to outlive the watcher
+    // ------------------------------------------------------------------------
+    void add(Shader &shader)
+    {
+        for (const std::string &source : shader.getSourcePaths())
+        {
+            std::string path = normalize(source);
+            files[path].shaders.insert(&shader);
+            files[path].modified = lastWriteTime(path);
+#ifdef __linux__
+            std::string directory = std::filesystem::path(path).parent_path().string();
+            if (inotifyFd >= 0 && directories.count(directory) == 0)
+            {
+                // editors often save by writing a new file and renaming it, so watch the directory and not the file
+                int wd = inotify_add_watch(inotifyFd, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+                if (wd >= 0)
+                {
+                    directories[directory] = wd;
+                    watchedDirectories[wd] = directory;
+                }
+            }
+#endif
+        }
+        shaders.insert(&shader);
+    }
+
+    // watch all variants of a set of shader files, including the ones that are compiled later
+    // ------------------------------------------------------------------------
+    void add(ShaderVariants &variants)
+    {
+        variantSets.push_back(&variants);
+        for (Shader *shader : variants.all())
+            add(*shader);
+    }
+
+    size_t fileCount() const { return files.size(); }
+
+    // call once per frame: starts reloading the shaders whose sources changed and swaps in the ones that finished;
+    // returns the shaders that got a new program, they have to be used again and their plain uniforms set again
+    // ------------------------------------------------------------------------
+    std::vector<Shader *> update()
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (ShaderVariants *variants : variantSets)
+            for (Shader *shader : variants->all())
+                if (shaders.count(shader) == 0)
+                    add(*shader);
+        collectChanges(now);
+
+        // wait until the files have been quiet for a moment, saving often touches a file more than once
+        if (!changed.empty() && now - lastChange > std::chrono::milliseconds(100))
+        {
+            for (Shader *shader : changed)
+            {
+                if (shader->isReloading())
+                    retry.insert(shader); // restart once the reload of the previous change is done
+                else
+                    shader->startReload();
+            }
+            changed.swap(retry);
+            retry.clear();
+        }
+
+        std::vector<Shader *> reloaded;
+        for (Shader *shader : shaders)
+            if (shader->pollReload())
+                reloaded.push_back(shader);
+        for (Shader *shader : reloaded)
+            add(*shader); // the reloaded sources may include other files now
+        return reloaded;
+    }
+
+private:
+    struct WatchedFile
+    {
+        std::set<Shader *> shaders;
+        std::filesystem::file_time_type modified;
+    };
+    std::map<std::string, WatchedFile> files;
+    std::set<Shader *> shaders;
+    std::vector<ShaderVariants *> variantSets;
+    std::set<Shader *> changed, retry;
+    std::chrono::steady_clock::time_point lastChange;
+    std::chrono::steady_clock::time_point lastPoll;
+
+#ifdef __linux__
+    int inotifyFd = -1;
+    std::map<std::string, int> directories;
+    std::map<int, std::string> watchedDirectories;
+#endif
+
+    static std::string normalize(const std::string &path)
+    {
+        return std::filesystem::path(path).lexically_normal().string();
+    }
+
+    static std::filesystem::file_time_type lastWriteTime(const std::string &path)
+    {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(path, error);
+        return error ? std::filesystem::file_time_type() : time;
+    }
+
+    void markChanged(const std::string &path, std::chrono::steady_clock::time_point now)
+    {
+        auto it = files.find(path);
+        if (it == files.end())
+            return;
+        changed.insert(it->second.shaders.begin(), it->second.shaders.end());
+        lastChange = now;
+    }
+
+    void collectChanges(std::chrono::steady_clock::time_point now)
+    {
+#ifdef __linux__
+        if (inotifyFd >= 0)
+        {
+            alignas(struct inotify_event) char buffer[4096];
+            ssize_t length;
+            while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+            {
+                for (char *p = buffer; p < buffer + length;)
+                {
+                    const struct inotify_event *event = (const struct inotify_event *)p;
+                    auto directory = watchedDirectories.find(event->wd);
+                    if (event->len > 0 && directory != watchedDirectories.end())
+                        markChanged(normalize((std::filesystem::path(directory->second) / event->name).string()), now);
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            return;
+        }
+#endif
+        // fallback: compare the modification times a few times per second
+        if (now - lastPoll < std::chrono::milliseconds(250))
+            return;
+        lastPoll = now;
+        for (auto &file : files)
+        {
+            auto modified = lastWriteTime(file.first);
+            if (modified != file.second.modified)
+            {
+                file.second.modified = modified;
+                markChanged(file.first, now);
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,248 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <glm/glm.hpp>
+
+#include <util/mesh.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Reduces the triangle count of a mesh by quadric error edge collapses (Garland/Heckbert). Collapses only move a
+// vertex onto one of its neighbors, so the simplified index buffer refers to the vertices of the original mesh and
+// every level of detail can share one vertex buffer.
+// Vertices on a border, on an attribute seam (several vertices at one position, e.g. different UVs or normals) or on a
+// non manifold edge never move, so seams stay closed; collapses that would flip a triangle are rejected.
+class MeshSimplifier
+{
+public:
+    // returns the triangles of the simplified mesh; stops at targetIndexCount or when the next collapse would move the
+    // surface further than maxError (object space units). error receives the largest error of all collapses done.
+    // ------------------------------------------------------------------------
+    static std::vector<unsigned int> simplify(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                                              size_t targetIndexCount, float maxError, float &error)
+    {
+        error = 0.0f;
+        std::vector<unsigned int> result(indices.begin(), indices.end() - indices.size() % 3);
+        if (vertices.empty())
+            return result;
+
+        std::vector<bool> locked = findLockedVertices(vertices, result);
+        std::vector<Quadric> quadrics(vertices.size());
+        for (size_t t = 0; t + 2 < result.size(); t += 3)
+        {
+            Quadric plane = Quadric::fromTriangle(vertices[result[t]].Position, vertices[result[t + 1]].Position, vertices[result[t + 2]].Position);
+            for (int corner = 0; corner < 3; corner++)
+                quadrics[result[t + corner]] += plane;
+        }
+
+        std::vector<unsigned int> remap(vertices.size());
+        std::vector<bool> touched(vertices.size());
+        std::vector<unsigned int> offsets, adjacency;
+        std::vector<Collapse> collapses;
+        const double maxCost = (double)maxError * maxError;
+        while (result.size() > targetIndexCount)
+        {
+            buildAdjacency(result, vertices.size(), offsets, adjacency);
+
+            // every edge in both directions, unless the vertex that would move is locked
+            collapses.clear();
+            for (size_t t = 0; t + 2 < result.size(); t += 3)
+            {
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    unsigned int a = result[t + corner], b = result[t + (corner + 1) % 3];
+                    if (!locked[a])
+                        collapses.push_back({a, b, cost(quadrics, vertices, a, b)});
+                    if (!locked[b])
+                        collapses.push_back({b, a, cost(quadrics, vertices, b, a)});
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y)
+                      { return x.cost < y.cost; });
+
+            // collapse the cheapest edges; a vertex takes part in one collapse per pass, so the checks stay valid
+            for (size_t v = 0; v < vertices.size(); v++)
+                remap[v] = (unsigned int)v;
+            std::fill(touched.begin(), touched.end(), false);
+            size_t removedIndices = 0;
+            size_t wanted = result.size() - targetIndexCount;
+            for (const Collapse &collapse : collapses)
+            {
+                if (collapse.cost > maxCost || removedIndices >= wanted)
+                    break;
+                if (touched[collapse.from] || touched[collapse.to] || flips(vertices, result, offsets, adjacency, remap, collapse.from, collapse.to))
+                    continue;
+                remap[collapse.from] = collapse.to;
+                touched[collapse.from] = touched[collapse.to] = true;
+                // its neighbors must not move in this pass either, their triangles changed
+                for (unsigned int a = offsets[collapse.from]; a < offsets[collapse.from + 1]; a++)
+                    for (int corner = 0; corner < 3; corner++)
+                        touched[result[adjacency[a] * 3 + corner]] = true;
+                quadrics[collapse.to] += quadrics[collapse.from];
+                error = std::max(error, (float)std::sqrt(std::max(collapse.cost, 0.0)));
+                removedIndices += 3 * sharedTriangles(result, offsets, adjacency, collapse.from, collapse.to);
+            }
+            if (removedIndices == 0)
+                break;
+
+            // apply the collapses and drop the triangles that became degenerate
+            size_t kept = 0;
+            for (size_t t = 0; t + 2 < result.size(); t += 3)
+            {
+                unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+                if (a == b || b == c || c == a)
+                    continue;
+                result[kept++] = a;
+                result[kept++] = b;
+                result[kept++] = c;
+            }
+            result.resize(kept);
+        }
+        return result;
+    }
+
+private:
+    // symmetric 4x4 matrix of the squared distances to a set of planes, weighted by the area of their triangles
+    struct Quadric
+    {
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+        double weight = 0;
+
+        static Quadric fromTriangle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2)
+        {
+            Quadric q;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(n);
+            if (length <= 0.0f)
+                return q;
+            n /= length;
+            double w = 0.5 * length; // area
+            double a = n.x, b = n.y, c = n.z, d = -glm::dot(n, p0);
+            q.a2 = w * a * a, q.ab = w * a * b, q.ac = w * a * c, q.ad = w * a * d;
+            q.b2 = w * b * b, q.bc = w * b * c, q.bd = w * b * d;
+            q.c2 = w * c * c, q.cd = w * c * d;
+            q.d2 = w * d * d;
+            q.weight = w;
+            return q;
+        }
+
+        Quadric &operator+=(const Quadric &o)
+        {
+            a2 += o.a2, ab += o.ab, ac += o.ac, ad += o.ad, b2 += o.b2, bc += o.bc, bd += o.bd, c2 += o.c2, cd += o.cd, d2 += o.d2;
+            weight += o.weight;
+            return *this;
+        }
+
+        // mean squared distance of p to the planes
+        double evaluate(const glm::vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double sum = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x + b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+                         c2 * z * z + 2 * cd * z + d2;
+            return weight > 0 ? sum / weight : 0;
+        }
+    };
+
+    struct Collapse
+    {
+        unsigned int from, to;
+        double cost;
+    };
+
+    static double cost(const std::vector<Quadric> &quadrics, const std::vector<Vertex> &vertices, unsigned int from, unsigned int to)
+    {
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        return q.evaluate(vertices[to].Position);
+    }
+
+    static std::vector<bool> findLockedVertices(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+    {
+        std::vector<bool> locked(vertices.size(), false);
+
+        // several vertices at one position: a seam in the UVs, normals or tangents
+        std::vector<std::pair<std::array<std::uint32_t, 3>, unsigned int>> positions(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++)
+        {
+            std::memcpy(positions[v].first.data(), &vertices[v].Position, sizeof(positions[v].first));
+            positions[v].second = (unsigned int)v;
+        }
+        std::sort(positions.begin(), positions.end());
+        for (size_t i = 1; i < positions.size(); i++)
+            if (positions[i].first == positions[i - 1].first)
+                locked[positions[i].second] = locked[positions[i - 1].second] = true;
+
+        // edges without exactly one opposite edge: borders and non manifold edges
+        std::unordered_map<std::uint64_t, int> edges;
+        auto edgeKey = [](unsigned int a, unsigned int b) { return ((std::uint64_t)a << 32) | b; };
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            for (int corner = 0; corner < 3; corner++)
+                edges[edgeKey(indices[t + corner], indices[t + (corner + 1) % 3])]++;
+        for (const auto &edge : edges)
+        {
+            unsigned int a = (unsigned int)(edge.first >> 32), b = (unsigned int)(edge.first & 0xffffffffu);
+            auto opposite = edges.find(edgeKey(b, a));
+            if (edge.second != 1 || opposite == edges.end() || opposite->second != 1)
+                locked[a] = locked[b] = true;
+        }
+        return locked;
+    }
+
+    // triangles per vertex, as offsets into one array
+    static void buildAdjacency(const std::vector<unsigned int> &indices, size_t vertexCount, std::vector<unsigned int> &offsets, std::vector<unsigned int> &adjacency)
+    {
+        offsets.assign(vertexCount + 1, 0);
+        for (unsigned int index : indices)
+            offsets[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] += offsets[v];
+        adjacency.resize(indices.size());
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    static size_t sharedTriangles(const std::vector<unsigned int> &indices, const std::vector<unsigned int> &offsets,
+                                  const std::vector<unsigned int> &adjacency, unsigned int from, unsigned int to)
+    {
+        size_t count = 0;
+        for (unsigned int a = offsets[from]; a < offsets[from + 1]; a++)
+        {
+            const unsigned int *t = &indices[adjacency[a] * 3];
+            if (t[0] == to || t[1] == to || t[2] == to)
+                count++;
+        }
+        return count;
+    }
+
+    // true if moving from onto to turns a remaining triangle around (or nearly so)
+    static bool flips(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, const std::vector<unsigned int> &offsets,
+                      const std::vector<unsigned int> &adjacency, const std::vector<unsigned int> &remap, unsigned int from, unsigned int to)
+    {
+        for (unsigned int a = offsets[from]; a < offsets[from + 1]; a++)
+        {
+            const unsigned int *t = &indices[adjacency[a] * 3];
+            if (t[0] == to || t[1] == to || t[2] == to)
+                continue; // collapses away
+            glm::vec3 before[3], after[3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                before[corner] = vertices[remap[t[corner]]].Position;
+                after[corner] = t[corner] == from ? vertices[to].Position : before[corner];
+            }
+            glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(n0, n1) <= 0.25f * glm::length(n0) * glm::length(n1))
+                return true;
+        }
+        return false;
+    }
+};
+#endif
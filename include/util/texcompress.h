@@ -0,0 +1,467 @@
+#ifndef TEXCOMPRESS_H
+#define TEXCOMPRESS_H
+
+#include <glad/glad.h>
+
+#include <util/threadpool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// the S3TC and BPTC formats are extensions to OpenGL 3.3, the loader may not declare them
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+enum class BlockFormat
+{
+    BC1, // RGB, 4 bits per pixel
+    BC3, // RGBA, 8 bits per pixel: BC1 color and a BC4 block for alpha
+    BC4, // one channel, 4 bits per pixel
+    BC5, // two channels, 8 bits per pixel: two BC4 blocks, e.g. normal maps with z reconstructed in the shader
+    BC7  // RGBA, 8 bits per pixel, fewer artifacts than BC1/BC3 but needs OpenGL 4.2 or ARB_texture_compression_bptc
+};
+
+// Block compression of 8 bit images on the CPU, used to bake textures offline (see src/tex-bake and util/ktx.h). Each
+// 4x4 block of pixels becomes 8 or 16 bytes that the GPU decodes while sampling.
+// Endpoints are taken from the principal axis of the block's colors and refined by a least squares fit to the chosen
+// indices. BC7 only uses mode 6 (one subset, 7 bit endpoints with p-bits, 4 bit indices). That is well below what an
+// exhaustive encoder reaches, but fast enough to bake all textures of a scene in seconds.
+class BlockCompressor
+{
+public:
+    static GLenum glFormat(BlockFormat format)
+    {
+        switch (format)
+        {
+        case BlockFormat::BC1:
+            return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BlockFormat::BC3:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BlockFormat::BC4:
+            return GL_COMPRESSED_RED_RGTC1;
+        case BlockFormat::BC5:
+            return GL_COMPRESSED_RG_RGTC2;
+        default:
+            return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        }
+    }
+
+    static GLenum glBaseFormat(BlockFormat format)
+    {
+        switch (format)
+        {
+        case BlockFormat::BC1:
+            return GL_RGB;
+        case BlockFormat::BC4:
+            return GL_RED;
+        case BlockFormat::BC5:
+            return GL_RG;
+        default:
+            return GL_RGBA;
+        }
+    }
+
+    static const char *name(BlockFormat format)
+    {
+        static const char *names[] = {"BC1", "BC3", "BC4", "BC5", "BC7"};
+        return names[(int)format];
+    }
+
+    static size_t blockBytes(BlockFormat format)
+    {
+        return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+    }
+
+    static size_t imageBytes(BlockFormat format, int width, int height)
+    {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+
+    // compresses an image with 1 to 4 channels of 8 bits, rows top to bottom without padding. Missing color channels
+    // read as 0 and a missing alpha as 255; blocks on the right and bottom border repeat the last column and row.
+    // ------------------------------------------------------------------------
+    static std::vector<unsigned char> compress(const unsigned char *pixels, int width, int height, int channels, BlockFormat format)
+    {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        size_t bytes = blockBytes(format);
+        std::vector<unsigned char> result(imageBytes(format, width, height));
+        GetThreadPool().parallelFor(0, blocksY, [&](int first, int last)
+                                    {
+                                        unsigned char block[16][4];
+                                        for (int by = first; by < last; by++)
+                                        {
+                                            for (int bx = 0; bx < blocksX; bx++)
+                                            {
+                                                fetchBlock(pixels, width, height, channels, bx * 4, by * 4, block);
+                                                encodeBlock(block, format, &result[((size_t)by * blocksX + bx) * bytes]);
+                                            }
+                                        }
+                                    });
+        return result;
+    }
+
+    // encodes the 16 RGBA pixels of one block (row by row) into blockBytes(format) bytes
+    // ------------------------------------------------------------------------
+    static void encodeBlock(const unsigned char block[16][4], BlockFormat format, unsigned char *out)
+    {
+        switch (format)
+        {
+        case BlockFormat::BC1:
+            encodeBC1(block, out);
+            break;
+        case BlockFormat::BC3:
+            encodeBC4(block, 3, out);
+            encodeBC1(block, out + 8);
+            break;
+        case BlockFormat::BC4:
+            encodeBC4(block, 0, out);
+            break;
+        case BlockFormat::BC5:
+            encodeBC4(block, 0, out);
+            encodeBC4(block, 1, out + 8);
+            break;
+        case BlockFormat::BC7:
+            encodeBC7(block, out);
+            break;
+        }
+    }
+
+private:
+    static void fetchBlock(const unsigned char *pixels, int width, int height, int channels, int x0, int y0, unsigned char block[16][4])
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            int x = std::min(x0 + i % 4, width - 1), y = std::min(y0 + i / 4, height - 1);
+            const unsigned char *pixel = pixels + ((size_t)y * width + x) * channels;
+            block[i][0] = block[i][1] = block[i][2] = 0;
+            block[i][3] = 255;
+            for (int c = 0; c < channels && c < 4; c++)
+                block[i][c] = pixel[c];
+        }
+    }
+
+    // mean and principal axis (unit length, or 0 for a block of one color) of the first n channels of a block
+    template <int N>
+    static void principalAxis(const unsigned char block[16][4], float mean[N], float axis[N])
+    {
+        for (int c = 0; c < N; c++)
+        {
+            mean[c] = 0.0f;
+            for (int i = 0; i < 16; i++)
+                mean[c] += block[i][c];
+            mean[c] /= 16.0f;
+        }
+        float covariance[N][N] = {};
+        for (int i = 0; i < 16; i++)
+            for (int a = 0; a < N; a++)
+                for (int b = 0; b < N; b++)
+                    covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+
+        // power iteration, starting from the channel that varies most
+        int widest = 0;
+        for (int c = 1; c < N; c++)
+            if (covariance[c][c] > covariance[widest][widest])
+                widest = c;
+        for (int c = 0; c < N; c++)
+            axis[c] = covariance[widest][c];
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[N] = {}, length = 0.0f;
+            for (int a = 0; a < N; a++)
+                for (int b = 0; b < N; b++)
+                    next[a] += covariance[a][b] * axis[b];
+            for (int c = 0; c < N; c++)
+                length += next[c] * next[c];
+            length = std::sqrt(length);
+            for (int c = 0; c < N; c++)
+                axis[c] = length > 1e-6f ? next[c] / length : 0.0f;
+        }
+    }
+
+    // the colors of the block at its extremes along the principal axis
+    template <int N>
+    static void axisEndpoints(const unsigned char block[16][4], float low[N], float high[N])
+    {
+        float mean[N], axis[N];
+        principalAxis<N>(block, mean, axis);
+        float minT = 0.0f, maxT = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < N; c++)
+                t += (block[i][c] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        for (int c = 0; c < N; c++)
+        {
+            low[c] = std::clamp(mean[c] + minT * axis[c], 0.0f, 255.0f);
+            high[c] = std::clamp(mean[c] + maxT * axis[c], 0.0f, 255.0f);
+        }
+    }
+
+    // endpoints that minimize the squared error if pixel i is (1 - weights[i]) * low + weights[i] * high;
+    // false if the weights don't determine them (all equal)
+    template <int N>
+    static bool fitEndpoints(const unsigned char block[16][4], const float weights[16], float low[N], float high[N])
+    {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f, ap[N] = {}, bp[N] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float b = weights[i], a = 1.0f - b;
+            aa += a * a, ab += a * b, bb += b * b;
+            for (int c = 0; c < N; c++)
+            {
+                ap[c] += a * block[i][c];
+                bp[c] += b * block[i][c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f)
+            return false;
+        for (int c = 0; c < N; c++)
+        {
+            low[c] = std::clamp((ap[c] * bb - bp[c] * ab) / determinant, 0.0f, 255.0f);
+            high[c] = std::clamp((bp[c] * aa - ap[c] * ab) / determinant, 0.0f, 255.0f);
+        }
+        return true;
+    }
+
+    // index of the palette entry closest to pixel, adds its squared distance to error
+    template <int N>
+    static int closest(const unsigned char pixel[4], const int (*palette)[4], int paletteSize, int &error)
+    {
+        int best = 0, bestError = 1 << 30;
+        for (int p = 0; p < paletteSize; p++)
+        {
+            int e = 0;
+            for (int c = 0; c < N; c++)
+            {
+                int d = (int)pixel[c] - palette[p][c];
+                e += d * d;
+            }
+            if (e < bestError)
+                best = p, bestError = e;
+        }
+        error += bestError;
+        return best;
+    }
+
+    // BC1: two RGB565 endpoints and 2 bit indices into them and the two colors between them
+    // ------------------------------------------------------------------------
+    struct BC1Block
+    {
+        std::uint16_t color0, color1;
+        std::uint32_t indices;
+        int error;
+    };
+
+    static std::uint16_t to565(const float color[3])
+    {
+        int r = (int)std::lround(color[0] * 31.0f / 255.0f), g = (int)std::lround(color[1] * 63.0f / 255.0f), b = (int)std::lround(color[2] * 31.0f / 255.0f);
+        return (std::uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    static void from565(std::uint16_t color, int rgb[4])
+    {
+        int r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+        rgb[3] = 255;
+    }
+
+    static BC1Block tryBC1(const unsigned char block[16][4], const float low[3], const float high[3])
+    {
+        BC1Block result;
+        result.color0 = to565(high);
+        result.color1 = to565(low);
+        if (result.color0 < result.color1)
+            std::swap(result.color0, result.color1);
+
+        // color0 > color1 selects the four color mode; if they are equal every pixel takes color0
+        int palette[4][4];
+        from565(result.color0, palette[0]);
+        from565(result.color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        int paletteSize = result.color0 == result.color1 ? 1 : 4;
+        result.indices = 0;
+        result.error = 0;
+        for (int i = 0; i < 16; i++)
+            result.indices |= (std::uint32_t)closest<3>(block[i], palette, paletteSize, result.error) << (2 * i);
+        return result;
+    }
+
+    static void encodeBC1(const unsigned char block[16][4], unsigned char *out)
+    {
+        float low[3], high[3];
+        axisEndpoints<3>(block, low, high);
+        BC1Block best = tryBC1(block, low, high);
+        for (int iteration = 0; iteration < 2 && best.error > 0; iteration++)
+        {
+            // palette entries 0..3 are color0, color1, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1
+            static const float weightOfIndex[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+            float weights[16];
+            for (int i = 0; i < 16; i++)
+                weights[i] = weightOfIndex[(best.indices >> (2 * i)) & 3];
+            if (!fitEndpoints<3>(block, weights, low, high))
+                break;
+            BC1Block refined = tryBC1(block, low, high);
+            if (refined.error >= best.error)
+                break;
+            best = refined;
+        }
+        out[0] = (unsigned char)(best.color0 & 0xff);
+        out[1] = (unsigned char)(best.color0 >> 8);
+        out[2] = (unsigned char)(best.color1 & 0xff);
+        out[3] = (unsigned char)(best.color1 >> 8);
+        for (int b = 0; b < 4; b++)
+            out[4 + b] = (unsigned char)(best.indices >> (8 * b));
+    }
+
+    // BC4: two 8 bit endpoints and 3 bit indices into them and six values between them
+    // ------------------------------------------------------------------------
+    static void encodeBC4(const unsigned char block[16][4], int channel, unsigned char *out)
+    {
+        int low = 255, high = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            low = std::min<int>(low, block[i][channel]);
+            high = std::max<int>(high, block[i][channel]);
+        }
+        std::memset(out, 0, 8);
+        out[0] = (unsigned char)high;
+        out[1] = (unsigned char)low;
+        if (high == low)
+            return; // every pixel takes endpoint 0
+
+        // high > low selects the eight value mode
+        int palette[8][4] = {};
+        palette[0][0] = high;
+        palette[1][0] = low;
+        for (int p = 2; p < 8; p++)
+            palette[p][0] = ((8 - p) * high + (p - 1) * low) / 7;
+        std::uint64_t indices = 0;
+        int error = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            unsigned char value[4] = {block[i][channel]};
+            indices |= (std::uint64_t)closest<1>(value, palette, 8, error) << (3 * i);
+        }
+        for (int b = 0; b < 6; b++)
+            out[2 + b] = (unsigned char)(indices >> (8 * b));
+    }
+
+    // BC7 mode 6: RGBA endpoints of 7 bits plus one shared lowest bit (p-bit) each, 4 bit indices
+    // ------------------------------------------------------------------------
+    struct BC7Block
+    {
+        int endpoints[2][4]; // 7 bits
+        int pbits[2];
+        unsigned char indices[16];
+        int error;
+    };
+
+    static BC7Block tryBC7(const unsigned char block[16][4], const float low[4], const float high[4])
+    {
+        static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+        BC7Block best;
+        best.error = 1 << 30;
+        for (int pbits = 0; pbits < 4; pbits++)
+        {
+            BC7Block result;
+            result.pbits[0] = pbits & 1;
+            result.pbits[1] = pbits >> 1;
+            int ends[2][4];
+            for (int c = 0; c < 4; c++)
+            {
+                result.endpoints[0][c] = std::clamp((int)std::lround((low[c] - result.pbits[0]) / 2.0f), 0, 127);
+                result.endpoints[1][c] = std::clamp((int)std::lround((high[c] - result.pbits[1]) / 2.0f), 0, 127);
+                ends[0][c] = (result.endpoints[0][c] << 1) | result.pbits[0];
+                ends[1][c] = (result.endpoints[1][c] << 1) | result.pbits[1];
+            }
+            int palette[16][4];
+            for (int p = 0; p < 16; p++)
+                for (int c = 0; c < 4; c++)
+                    palette[p][c] = ((64 - weights[p]) * ends[0][c] + weights[p] * ends[1][c] + 32) >> 6;
+            result.error = 0;
+            for (int i = 0; i < 16 && result.error < best.error; i++)
+                result.indices[i] = (unsigned char)closest<4>(block[i], palette, 16, result.error);
+            if (result.error < best.error)
+                best = result;
+        }
+        return best;
+    }
+
+    static void encodeBC7(const unsigned char block[16][4], unsigned char *out)
+    {
+        float low[4], high[4];
+        axisEndpoints<4>(block, low, high);
+        BC7Block best = tryBC7(block, low, high);
+        if (best.error > 0)
+        {
+            float weights[16];
+            for (int i = 0; i < 16; i++)
+                weights[i] = best.indices[i] / 15.0f;
+            if (fitEndpoints<4>(block, weights, low, high))
+            {
+                BC7Block refined = tryBC7(block, low, high);
+                if (refined.error < best.error)
+                    best = refined;
+            }
+        }
+
+        // the highest index bit of pixel 0 is not stored, it has to be 0: swap the endpoints if it isn't
+        if (best.indices[0] >= 8)
+        {
+            for (int c = 0; c < 4; c++)
+                std::swap(best.endpoints[0][c], best.endpoints[1][c]);
+            std::swap(best.pbits[0], best.pbits[1]);
+            for (int i = 0; i < 16; i++)
+                best.indices[i] = (unsigned char)(15 - best.indices[i]);
+        }
+
+        std::memset(out, 0, 16);
+        int position = 0;
+        auto write = [&](std::uint32_t value, int bits)
+        {
+            for (int b = 0; b < bits; b++, position++)
+                if ((value >> b) & 1)
+                    out[position >> 3] |= (unsigned char)(1 << (position & 7));
+        };
+        write(1 << 6, 7); // mode 6
+        for (int c = 0; c < 4; c++)
+        {
+            write(best.endpoints[0][c], 7);
+            write(best.endpoints[1][c], 7);
+        }
+        write(best.pbits[0], 1);
+        write(best.pbits[1], 1);
+        for (int i = 0; i < 16; i++)
+            write(best.indices[i], i == 0 ? 3 : 4);
+    }
+};
+#endif
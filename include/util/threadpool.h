@@ -0,0 +1,136 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that execute queued tasks.
+// Use GetThreadPool() to share one pool between all utilities instead of creating new threads.
+class ThreadPool
+{
+public:
+    ThreadPool(unsigned int threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1)
+    {
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this]() { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned int size() const { return (unsigned int)workers.size(); }
+
+    // queues a task and returns a future for its result
+    // ------------------------------------------------------------------------
+    template <class F>
+    auto submit(F &&f) -> std::future<decltype(f())>
+    {
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::forward<F>(f));
+        auto result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push([task]() { (*task)(); });
+        }
+        wakeup.notify_one();
+        return result;
+    }
+
+    // calls func(first, last) for slices of [begin, end) on all threads and returns once every slice is done.
+    // The calling thread works on the slices too, so this is also safe to call from within a task of the pool.
+    // ------------------------------------------------------------------------
+    void parallelFor(int begin, int end, const std::function<void(int, int)> &func, int sliceSize = 1)
+    {
+        if (end <= begin)
+            return;
+        sliceSize = std::max(sliceSize, 1);
+
+        struct Job
+        {
+            std::atomic<int> next;
+            std::atomic<int> done;
+            int sliceCount;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto job = std::make_shared<Job>();
+        job->next = 0;
+        job->done = 0;
+        job->sliceCount = (end - begin + sliceSize - 1) / sliceSize;
+
+        auto work = [job, begin, end, sliceSize, func]()
+        {
+            int slice;
+            while ((slice = job->next++) < job->sliceCount)
+            {
+                int first = begin + slice * sliceSize;
+                func(first, std::min(first + sliceSize, end));
+                if (++job->done == job->sliceCount)
+                {
+                    std::lock_guard<std::mutex> lock(job->mutex);
+                    job->finished.notify_all();
+                }
+            }
+        };
+
+        int helpers = std::min((int)size(), job->sliceCount - 1);
+        for (int i = 0; i < helpers; i++)
+            submit(work);
+        work();
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&job]() { return job->done == job->sliceCount; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+};
+
+// the pool shared by all utilities
+// ---------------------------------------------------
+ThreadPool &GetThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+#endif
@@ -0,0 +1,29 @@
+// phong lighting with a white light, shared by the apps through the SHADER_INCLUDE_DIRECTORY
+// SPECULAR_EXPONENT is baked into the program as a define, see ShaderDefines
+
+#ifndef SPECULAR_EXPONENT
+#define SPECULAR_EXPONENT 1
+#endif
+
+vec3 phongLighting(vec3 nnormal, vec3 fragPos, vec3 lightPos, vec3 cameraPos)
+{
+	vec3 lightColor = vec3(1.0, 1.0, 1.0);
+
+	// ambient
+	float ambientStrength = 0.1;
+	vec3 ambient = ambientStrength * lightColor;
+
+	// diffuse 
+	vec3 lightDir = normalize(lightPos - fragPos);
+	float angle = max(dot(nnormal, lightDir), 0.0);
+	vec3 diffuse = angle * lightColor;
+
+	// specular
+	float specularStrength = 1.0;
+	vec3 viewDir = normalize(cameraPos - fragPos);
+	vec3 reflectDir = reflect(-lightDir, nnormal);
+	float specFactor = pow(max(dot(viewDir, reflectDir), 0.0), SPECULAR_EXPONENT);
+	vec3 specular = specularStrength * specFactor * lightColor;
+
+	return ambient + diffuse + specular;
+}
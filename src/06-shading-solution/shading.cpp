@@ -46,7 +46,8 @@ int main()
     InitWindowAndGUI(WIDTH, HEIGHT, APP_NAME);
     SetFramebufferSizeCallback(framebuffer_size_callback);
 
-    Shader myShader("../src/06-shading-solution/shading.vert", "../src/06-shading-solution/shading.frag");
+    // the lighting comes from resources/shaders/lighting.glsl like in 06-shading, only the specular exponent differs
+    Shader myShader("../src/06-shading-solution/shading.vert", "../src/06-shading-solution/shading.frag", nullptr, {{"SPECULAR_EXPONENT", "128"}});
     glm::vec4 bgColor = {0.1, 0.1, 0.1, 1.0};
     glm::vec3 objectColor = {0.9, 0.7, 0.1};
 
@@ -64,6 +65,10 @@ int main()
 
         processInput(window);
 
+        // uniform uploads of the last frame, see Shader::setX
+        UniformCounters uniformCounters = GetUniformCounters();
+        GetUniformCounters() = UniformCounters();
+
         // START: UI-Stuff
         if (gui)
         {
@@ -87,6 +92,7 @@ int main()
                 }
 
                 ImGui::Text("FPS: %.1f", ImGui::GetIO().Framerate); // show framerate
+                ImGui::Text("uniform uploads: %zu, skipped: %zu", uniformCounters.uploads, uniformCounters.skipped);
                 ImGui::End();
             }
             ImGui::Render();
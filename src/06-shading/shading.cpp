@@ -4,27 +4,45 @@
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <chrono> // for timing
+#include <memory>
+#include <algorithm>
+#include <cstddef> // for offsetof
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <util/assets.h>
 #include <util/shader.h>
+#include <util/shaderwatcher.h>
 #include <util/camera.h>
 #include <util/model.h>
 #include <util/window.h>
+#include <util/frustum.h>
+#include <util/heightfield.h>
 
 constexpr int vertexCount = 36; // per cube that is
 constexpr int colorComponentsPerVertex = 3;
 constexpr int offsetComponentsPerVertex = 3;
+constexpr int CHUNK_SIZE = 32; // cubes per side of a chunk (tile) of the wall
+constexpr int LOD_LEVELS = 6; // levels of the image pyramid, the last one draws a whole 32x32 chunk as one cube
 
 using namespace glm;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void processInput(GLFWwindow* window);
 void prepareCubes();
 void renderCubes();
+void prepareCubeChunks();
+void prepareInstancedCubes();
+void renderInstancedCubes();
+void prepareMergedCubes();
+void renderMergedCubes(Shader& shader, Shader& flatShader, const mat4& projection, const mat4& view, const mat4& model);
+void collectVisibleChunks(const mat4& projection, const mat4& view, const mat4& model);
+void updateRipples(const mat4& projection, const mat4& view, const mat4& model);
+void renderCubeWall(Shader& shader, Shader* flatShader, const mat4& projection, const mat4& view, const mat4& model);
 
 int WIDTH = 800;
 int HEIGHT = 600;
@@ -55,18 +73,133 @@ unsigned char* image;
 int width, height;
 
 vec2 mousePos = vec2(0.0f, 0.0f);
+bool mouseClicked = false; // set by the mouse button callback, a ripple is started in the next frame
+
+// the ripples are simulated on the CPU as a heightfield with one height per cube and uploaded as a float texture
+// -------------------------------------------------
+constexpr float maxWaveAmplitude = 50.0f; // largest z displacement of a cube
+constexpr float flatThreshold = 0.01f;    // tiles whose heights all stay below this are considered flat
+std::unique_ptr<Heightfield> heightfield;
+unsigned int heightMapTexture = 0;
+float clickAmplitude = 40.0f;
+float hoverAmplitude = 8.0f;
+float simulationMs = 0.0f;
+
+// per-frame constants go into one uniform buffer, per-draw data into a ring of uniform blocks (see util/shader.h)
+// -------------------------------------------------
+struct CubeDrawUniforms // mirrors the DrawUniforms block of shading.vert (std140)
+{
+	DrawUniforms transform; // model and normal matrix, position scale and offset
+	float cellSize = 1.0f;
+	float lodBlend = 0.0f;
+	float pad[2];
+};
+std::unique_ptr<UniformBuffer> frameUniforms;
+std::unique_ptr<UniformRing> drawUniforms;
+DrawUniforms wallTransform; // of the current frame
+
+// features of the wall shaders are compiled into variants instead of being switched with uniforms
+// -------------------------------------------------
+bool ripplesEnabled = true;    // displace the cubes by the heightfield
+bool useObjectColor = false;   // one color for all cubes instead of the image
+constexpr UniformId OBJECT_COLOR("objectColor");
+
+ShaderDefines wallShaderFeatures(bool flatMerged)
+{
+	ShaderDefines defines;
+	if (ripplesEnabled && !flatMerged)
+		defines["RIPPLES"] = ""; // the merged faces are only drawn where the wall is flat
+	if (useObjectColor)
+		defines["OBJECT_COLOR"] = "";
+	return defines;
+}
+
+// the cube wall can be drawn with different strategies, selectable in the GUI so they can be compared
+// -------------------------------------------------
+enum CubeRenderMode
+{
+	PER_CUBE = 0,  // one VAO and five VBOs per pixel, one draw call per cube
+	INSTANCED = 1, // one shared indexed cube plus a per-instance buffer, one draw call in total
+	MERGED = 2,    // hidden faces removed and same colored front faces merged while the wall is flat, instanced cubes where it ripples
+	CUBE_RENDER_MODE_COUNT
+};
+const char* cubeRenderModeNames[CUBE_RENDER_MODE_COUNT] = { "per cube", "instanced", "merged" };
+int cubeRenderMode = INSTANCED;
+
+// statistics that are collected per render path to compare them
+struct CubePathStats
+{
+	bool prepared = false;
+	float prepareMs = 0.0f;   // time spent creating the buffers
+	size_t gpuBytes = 0;      // bytes uploaded into buffer objects
+	size_t bufferCount = 0;   // number of buffer objects
+	int drawCalls = 0;        // draw calls issued in the last frame
+	size_t triangles = 0;     // triangles drawn in the last frame
+};
+CubePathStats cubePathStats[CUBE_RENDER_MODE_COUNT];
+
+// the wall is split into tiles which are frustum culled, see collectVisibleChunks()
+bool tileCulling = true;
+int drawnTiles = 0;
+int culledTiles = 0;
+
+// distant tiles are drawn from coarser levels of the image pyramid, see chooseChunkLod()
+bool distanceLod = true;
+float lodPixelSize = 2.0f; // a cube is blended into its coarser level once it gets smaller than this on screen
+int lodTileCounts[LOD_LEVELS] = {};
+
+// the image reduced into a mip pyramid, distant tiles of the wall draw one averaged cube per 2x2, 4x4, ... block
+// -------------------------------------------------
+struct ImageLevel
+{
+	int width, height;
+	std::vector<unsigned char> rgb;
+};
+std::vector<ImageLevel> imagePyramid;
+
+void buildImagePyramid()
+{
+	imagePyramid.clear();
+	ImageLevel base;
+	base.width = width;
+	base.height = height;
+	base.rgb.assign(image, image + (size_t)width * height * colorComponentsPerVertex);
+	imagePyramid.push_back(std::move(base));
+
+	for (int level = 1; level < LOD_LEVELS; ++level) {
+		const ImageLevel& fine = imagePyramid.back();
+		ImageLevel coarse;
+		coarse.width = std::max(1, (fine.width + 1) / 2);
+		coarse.height = std::max(1, (fine.height + 1) / 2);
+		coarse.rgb.resize((size_t)coarse.width * coarse.height * colorComponentsPerVertex);
+		for (int y = 0; y < coarse.height; ++y) {
+			for (int x = 0; x < coarse.width; ++x) {
+				// average the 2x2 block, clamped at the border of odd sized levels
+				int x0 = std::min(2 * x, fine.width - 1), x1 = std::min(2 * x + 1, fine.width - 1);
+				int y0 = std::min(2 * y, fine.height - 1), y1 = std::min(2 * y + 1, fine.height - 1);
+				for (int c = 0; c < colorComponentsPerVertex; ++c) {
+					int sum = fine.rgb[(y0 * fine.width + x0) * colorComponentsPerVertex + c] + fine.rgb[(y0 * fine.width + x1) * colorComponentsPerVertex + c]
+						+ fine.rgb[(y1 * fine.width + x0) * colorComponentsPerVertex + c] + fine.rgb[(y1 * fine.width + x1) * colorComponentsPerVertex + c];
+					coarse.rgb[(y * coarse.width + x) * colorComponentsPerVertex + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		imagePyramid.push_back(std::move(coarse));
+	}
+}
 
 void loadTexture()
 {
 
 	int nrComponents;
-	stbi_set_flip_vertically_on_load(true); // this flips the loaded images vertically
 	image = stbi_load("../resources/images/klein.jpg", &width, &height, &nrComponents, 0);
 
 	if (!image)
 	{
 		std::cout << "Failed to load texture" << std::endl;
 	}
+	else
+		FlipRows(image, width, height, nrComponents); // not stbi_set_flip_vertically_on_load, it is global to all loads
 }
 
 int main()
@@ -74,19 +207,50 @@ int main()
 	InitWindowAndGUI(WIDTH, HEIGHT, APP_NAME);
 	SetFramebufferSizeCallback(framebuffer_size_callback);
 	SetCursorPosCallback(mouse_callback);
+	SetMouseButtonCallback(mouse_button_callback);
 
-	Shader myShader("../src/06-shading/shading.vert", "../src/06-shading/shading.frag");
+	// the grid pitch is a constant of all variants; the height map sampler keeps its default, texture unit 0
+	ShaderVariants wallShaders("../src/06-shading/shading.vert", "../src/06-shading/shading.frag", "",
+		{ { "GRID_PITCH", ShaderFloat(2.0f + DISTANCE_BETWEEN_CUBES) } });
+	Shader* wallShader = &wallShaders.get(wallShaderFeatures(false));
 	glm::vec4 bgColor = { 0.1, 0.1, 0.1, 1.0 };
 	glm::vec3 objectColor = { 0.9, 0.7, 0.1 };
 
-	myShader.use();
+	wallShader->use();
 
-	prepareCubes();
+	// edited shader sources are recompiled in the background and swapped in once they linked
+	ShaderWatcher shaderWatcher;
+	shaderWatcher.add(wallShaders);
+
+	loadTexture();
+	buildImagePyramid();
+	prepareCubeChunks();
+
+	heightfield = std::make_unique<Heightfield>(width, height, CHUNK_SIZE, maxWaveAmplitude);
+	glGenTextures(1, &heightMapTexture);
+	glBindTexture(GL_TEXTURE_2D, heightMapTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, heightfield->data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// every visible tile has its own block, plus the one of the unscaled cubes
+	int tileCount = ((width + CHUNK_SIZE - 1) / CHUNK_SIZE) * ((height + CHUNK_SIZE - 1) / CHUNK_SIZE);
+	frameUniforms = std::make_unique<UniformBuffer>(FRAME_UNIFORMS_BINDING, sizeof(FrameUniforms));
+	drawUniforms = std::make_unique<UniformRing>(DRAW_UNIFORMS_BINDING, sizeof(CubeDrawUniforms), tileCount + 1);
 
 	cameraPos = vec3(30, 30, 60);
 
 	glEnable(GL_DEPTH_TEST);
 
+	// GPU time of the cube wall, measured with two alternating timer queries so reading back a result never stalls
+	GLuint gpuTimerQueries[2];
+	bool gpuTimerIssued[2] = { false, false };
+	float gpuFrameMs = 0.0f;
+	int frameIndex = 0;
+	glGenQueries(2, gpuTimerQueries);
+
 	// Main Loop
 	while (!glfwWindowShouldClose(window))
 	{
@@ -97,6 +261,13 @@ int main()
 
 		processInput(window);
 
+		// swap in shaders that finished compiling; all their uniforms are set again below
+		shaderWatcher.update();
+
+		// uniform uploads of the last frame, see Shader::setX
+		UniformCounters uniformCounters = GetUniformCounters();
+		GetUniformCounters() = UniformCounters();
+
 		// START: UI-Stuff
 		if (gui)
 		{
@@ -112,14 +283,48 @@ int main()
 				ImGui::ColorEdit3("object color", value_ptr(objectColor));
 
 				// a Button to reload the shader (so you don't need to recompile the cpp all the time)
+				// saving a watched source file reloads it as well; both finish in the background, see below
 				if (ImGui::Button("reload shaders"))
-				{
-					auto& shader = myShader;
-					shader.reload();
-					shader.use();
-				}
+					for (Shader* shader : wallShaders.all())
+						shader->startReload();
+				ImGui::SameLine();
+				if (wallShader->isReloading())
+					ImGui::Text("compiling ...");
+				else
+					ImGui::Text("watching %zu files", shaderWatcher.fileCount());
 
 				ImGui::Text("FPS: %.1f", ImGui::GetIO().Framerate); // show framerate
+				ImGui::Text("frame time: %.2f ms (GPU cube wall: %.2f ms)", 1000.0f / ImGui::GetIO().Framerate, gpuFrameMs);
+				ImGui::Text("shader load: %.1f ms (%s)", wallShader->getLoadMs(), wallShader->isFromCache() ? "warm, from the program cache" : "cold, compiled");
+				ImGui::Checkbox("ripples", &ripplesEnabled);
+				ImGui::SameLine();
+				ImGui::Checkbox("use object color", &useObjectColor);
+				ImGui::Text("shader variants: %zu", wallShaders.size());
+
+				// switch between the render paths of the cube wall; each path is created on first use
+				ImGui::Combo("render path", &cubeRenderMode, cubeRenderModeNames, CUBE_RENDER_MODE_COUNT);
+				ImGui::Checkbox("tile culling", &tileCulling);
+				ImGui::Text("tiles: %d drawn, %d culled", drawnTiles, culledTiles);
+				ImGui::Checkbox("distance LOD", &distanceLod);
+				ImGui::SliderFloat("LOD pixel size", &lodPixelSize, 0.5f, 16.0f);
+				ImGui::Text("tiles per LOD: %d / %d / %d / %d / %d / %d", lodTileCounts[0], lodTileCounts[1], lodTileCounts[2],
+					lodTileCounts[3], lodTileCounts[4], lodTileCounts[5]);
+				ImGui::Text("ripples: %zu active, simulation %.2f ms", heightfield->rippleCount(), simulationMs);
+				ImGui::SliderFloat("click amplitude", &clickAmplitude, 0.0f, maxWaveAmplitude);
+				ImGui::SliderFloat("hover amplitude", &hoverAmplitude, 0.0f, maxWaveAmplitude);
+				ImGui::SliderFloat("wave speed", &heightfield->waveSpeed, 0.05f, 0.49f);
+				ImGui::SliderFloat("damping", &heightfield->damping, 0.9f, 1.0f);
+				ImGui::Text("uniform uploads: %zu, skipped: %zu", uniformCounters.uploads, uniformCounters.skipped);
+				ImGui::Text("per-draw uniform blocks: %d, frames stalled on the ring: %d, grown: %d", drawUniforms->stagedBlocks(),
+					drawUniforms->stalledFrames(), drawUniforms->growths());
+				for (int i = 0; i < CUBE_RENDER_MODE_COUNT; ++i)
+				{
+					const CubePathStats& stats = cubePathStats[i];
+					if (!stats.prepared)
+						continue;
+					ImGui::Text("%s: startup %.1f ms, %zu buffers, %.2f MB, %d draw calls, %zu triangles", cubeRenderModeNames[i],
+						stats.prepareMs, stats.bufferCount, stats.gpuBytes / (1024.0f * 1024.0f), stats.drawCalls, stats.triangles);
+				}
 				ImGui::End();
 			}
 			ImGui::Render();
@@ -138,17 +343,55 @@ int main()
 		model = translate(model, vec3(0.0f, 0.0f, 0.0f));
 		model = scale(model, vec3(0.2f, 0.2f, 0.2f));
 
-		myShader.setMat4("projection", projection);
-		myShader.setMat4("view", view);
-		myShader.setMat4("model", model);
-
-		myShader.setVec3("cameraPos", cameraPos);
-		myShader.setVec3("lightPos", lightPos);
-
-		myShader.setVec2("mousePos", mousePos);
-		myShader.setFloat("time", currentFrame);
+		FrameUniforms frame = {};
+		frame.projection = projection;
+		frame.view = view;
+		frame.cameraPos = vec4(cameraPos, 1.0f);
+		frame.lightPos = vec4(lightPos, 1.0f);
+		frame.mousePos = mousePos;
+		frame.time = currentFrame;
+		frameUniforms->update(frame);
+		wallTransform = DrawUniforms(model); // the normal matrix is computed here once instead of per vertex
+
+		if (ripplesEnabled)
+			updateRipples(projection, view, model);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, heightMapTexture);
+
+		// the variants for the selected features, each compiled the first time it is needed
+		wallShader = &wallShaders.get(wallShaderFeatures(false));
+		Shader* flatShader = cubeRenderMode == MERGED ? &wallShaders.get(wallShaderFeatures(true)) : nullptr;
+		if (useObjectColor)
+		{
+			for (Shader* shader : { wallShader, flatShader })
+			{
+				if (!shader)
+					continue;
+				shader->use();
+				shader->setVec3(OBJECT_COLOR, objectColor);
+			}
+		}
 
-		renderCubes();
+		int query = frameIndex % 2;
+		glBeginQuery(GL_TIME_ELAPSED, gpuTimerQueries[query]);
+		drawUniforms->beginFrame();
+		renderCubeWall(*wallShader, flatShader, projection, view, model);
+		drawUniforms->endFrame();
+		glEndQuery(GL_TIME_ELAPSED);
+		gpuTimerIssued[query] = true;
+
+		// read the query of the previous frame, which is usually finished by now
+		int previousQuery = 1 - query;
+		GLint available = 0;
+		if (gpuTimerIssued[previousQuery])
+			glGetQueryObjectiv(gpuTimerQueries[previousQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 elapsedNs = 0;
+			glGetQueryObjectui64v(gpuTimerQueries[previousQuery], GL_QUERY_RESULT, &elapsedNs);
+			gpuFrameMs = elapsedNs / 1.0e6f;
+		}
+		frameIndex++;
 
 		if (gui)
 			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -156,6 +399,7 @@ int main()
 		glfwPollEvents();
 	}
 
+	glDeleteQueries(2, gpuTimerQueries);
 	stbi_image_free(image);
 	DestroyWindow();
 	return 0;
@@ -203,7 +447,6 @@ std::vector<unsigned int> cubeVAOS;
 
 void prepareCubes()
 {
-	loadTexture();
 	cubeVAOS.resize(width * height, 0);
 
 	float positions[] = {
@@ -373,9 +616,9 @@ void prepareCubes()
 
 		float offsets[vertexCount * offsetComponentsPerVertex] = {};
 
-		// Create the offset array
-		float xOffset = (float)(i % width) * (2.0f + DISTANCE_BETWEEN_CUBES);
-		float yOffset = (float)(i / width) * (2.0f + DISTANCE_BETWEEN_CUBES);
+		// Create the offset array (grid cell of the cube, the shader spaces the cells by gridPitch)
+		float xOffset = (float)(i % width);
+		float yOffset = (float)(i / width);
 		float zOffset = 0.0f;
 
 		for (int i = 0; i < vertexCount; ++i) {
@@ -446,15 +689,658 @@ void prepareCubes()
 		glBindBuffer(GL_ARRAY_BUFFER, 0); // Unbind VBO
 		glBindVertexArray(0);             // Unbind VAO
 	}
+
+	CubePathStats& stats = cubePathStats[PER_CUBE];
+	stats.bufferCount = (size_t)width * height * 5;
+	stats.gpuBytes = (size_t)width * height * (sizeof(positions) + sizeof(normals) + sizeof(uvs) + 2 * vertexCount * 3 * sizeof(float));
 }
 
+// stages per-draw uniforms of the wall and returns their block; renderCubeWall() uploads them before the first draw
+int stageWallDraw(float cellSize, float lodBlend)
+{
+	CubeDrawUniforms draw;
+	draw.transform = wallTransform;
+	draw.cellSize = cellSize;
+	draw.lodBlend = lodBlend;
+	return drawUniforms->stage(draw);
+}
+int wallBlock = -1; // unscaled and unblended cubes, staged every frame
+
 void renderCubes()
 {
+	drawUniforms->bind(wallBlock);
 	for (int i = 0; i < width * height; ++i) {
 		glBindVertexArray(cubeVAOS[i]);
 		glDrawArrays(GL_TRIANGLES, 0, vertexCount);
 		glBindVertexArray(0);
 	}
+	cubePathStats[PER_CUBE].drawCalls = width * height;
+	cubePathStats[PER_CUBE].triangles = (size_t)width * height * vertexCount / 3;
+}
+
+// the wall is split into square chunks of cubes; the instance buffer and the merged mesh are stored chunk by chunk
+// -------------------------------------------------
+struct CubeChunk
+{
+	int x0, y0, w, h;       // covered grid cells
+	GLint firstInstance[LOD_LEVELS];    // range in the instance buffer per level of the image pyramid
+	GLsizei instanceCount[LOD_LEVELS];
+	size_t firstIndex;      // range in the index buffer of the merged mesh
+	GLsizei indexCount;
+};
+std::vector<CubeChunk> cubeChunks;
+int chunksX = 0, chunksY = 0;
+
+// the chunks are the leaves of a quadtree, so whole regions of the wall can be culled with a single test
+// -------------------------------------------------
+struct QuadtreeNode
+{
+	vec3 boundsMin, boundsMax; // model space, including the wave
+	int children[4];           // indices into chunkQuadtree, -1 if unused
+	int chunk;                 // index into cubeChunks for leaves, -1 otherwise
+	int leafCount;
+};
+std::vector<QuadtreeNode> chunkQuadtree;
+
+struct VisibleChunk
+{
+	const CubeChunk* chunk;
+	int lod;     // level of the image pyramid to draw
+	float blend; // how far the colors are blended towards the next coarser level
+	int drawBlock = -1; // its per-draw uniforms in the ring, staged by renderCubeWall()
+};
+std::vector<VisibleChunk> visibleChunks; // sorted front to back
+
+void chunkBounds(const CubeChunk& chunk, vec3& boundsMin, vec3& boundsMax)
+{
+	const float pitch = 2.0f + DISTANCE_BETWEEN_CUBES;
+	boundsMin = vec3(chunk.x0 * pitch - 1.0f, chunk.y0 * pitch - 1.0f, -1.0f - maxWaveAmplitude);
+	boundsMax = vec3((chunk.x0 + chunk.w - 1) * pitch + 1.0f, (chunk.y0 + chunk.h - 1) * pitch + 1.0f, 1.0f + maxWaveAmplitude);
+}
+
+// picks the pyramid level from the projected size of a cube at the closest point of the tile
+void chooseChunkLod(VisibleChunk& visible, const vec3& cameraInModel, const mat4& projection)
+{
+	visible.lod = 0;
+	visible.blend = 0.0f;
+	if (!distanceLod)
+		return;
+
+	vec3 boundsMin, boundsMax;
+	chunkBounds(*visible.chunk, boundsMin, boundsMax);
+	float distance = std::max(length(clamp(cameraInModel, boundsMin, boundsMax) - cameraInModel), 1e-3f);
+
+	// the model scale cancels out: both the cube size and the distance are measured in model space
+	const float pitch = 2.0f + DISTANCE_BETWEEN_CUBES;
+	float cubePixels = pitch * projection[1][1] * 0.5f * HEIGHT / distance;
+	float lod = glm::clamp(std::log2(lodPixelSize / cubePixels), 0.0f, (float)(LOD_LEVELS - 1));
+	visible.lod = std::min((int)lod, LOD_LEVELS - 1);
+	visible.blend = visible.lod == LOD_LEVELS - 1 ? 0.0f : lod - visible.lod;
+}
+
+// builds the node covering the chunks [cx0, cx1) x [cy0, cy1) and returns its index
+int buildQuadtree(int cx0, int cy0, int cx1, int cy1)
+{
+	QuadtreeNode node;
+	node.children[0] = node.children[1] = node.children[2] = node.children[3] = -1;
+	node.chunk = -1;
+	node.leafCount = 0;
+
+	int nodeIndex = (int)chunkQuadtree.size();
+	chunkQuadtree.push_back(node);
+
+	if (cx1 - cx0 == 1 && cy1 - cy0 == 1) {
+		node.chunk = cy0 * chunksX + cx0;
+		node.leafCount = 1;
+		chunkBounds(cubeChunks[node.chunk], node.boundsMin, node.boundsMax);
+	}
+	else {
+		// split the longer sides in half, a side of one chunk is not split
+		int mx = cx1 - cx0 > 1 ? (cx0 + cx1) / 2 : cx1;
+		int my = cy1 - cy0 > 1 ? (cy0 + cy1) / 2 : cy1;
+		int ranges[4][4] = { { cx0, cy0, mx, my }, { mx, cy0, cx1, my }, { cx0, my, mx, cy1 }, { mx, my, cx1, cy1 } };
+		node.boundsMin = vec3(1e30f);
+		node.boundsMax = vec3(-1e30f);
+		for (int i = 0; i < 4; ++i) {
+			if (ranges[i][0] >= ranges[i][2] || ranges[i][1] >= ranges[i][3])
+				continue;
+			int child = buildQuadtree(ranges[i][0], ranges[i][1], ranges[i][2], ranges[i][3]);
+			node.children[i] = child;
+			node.leafCount += chunkQuadtree[child].leafCount;
+			node.boundsMin = min(node.boundsMin, chunkQuadtree[child].boundsMin);
+			node.boundsMax = max(node.boundsMax, chunkQuadtree[child].boundsMax);
+		}
+	}
+
+	chunkQuadtree[nodeIndex] = node;
+	return nodeIndex;
+}
+
+void cullQuadtree(int nodeIndex, const Frustum& frustum, bool inside)
+{
+	const QuadtreeNode& node = chunkQuadtree[nodeIndex];
+	if (!inside) {
+		Frustum::Result result = frustum.testBox(node.boundsMin, node.boundsMax);
+		if (result == Frustum::OUTSIDE) {
+			culledTiles += node.leafCount;
+			return;
+		}
+		inside = result == Frustum::INSIDE; // no need to test the children
+	}
+
+	if (node.chunk >= 0) {
+		visibleChunks.push_back({ &cubeChunks[node.chunk], 0, 0.0f });
+		return;
+	}
+	for (int i = 0; i < 4; ++i)
+		if (node.children[i] >= 0)
+			cullQuadtree(node.children[i], frustum, inside);
+}
+
+// fills visibleChunks with the chunks inside the view frustum, sorted front to back so early-Z rejects hidden fragments
+void collectVisibleChunks(const mat4& projection, const mat4& view, const mat4& model)
+{
+	visibleChunks.clear();
+	culledTiles = 0;
+	vec3 cameraInModel = vec3(inverse(model) * vec4(cameraPos, 1.0f));
+
+	if (!tileCulling || chunkQuadtree.empty()) {
+		for (const CubeChunk& chunk : cubeChunks)
+			visibleChunks.push_back({ &chunk, 0, 0.0f });
+	}
+	else {
+		cullQuadtree(0, Frustum(projection * view * model), false);
+
+		const float pitch = 2.0f + DISTANCE_BETWEEN_CUBES;
+		auto distanceToCamera = [&](const VisibleChunk& visible) {
+			const CubeChunk* chunk = visible.chunk;
+			vec3 center = vec3((chunk->x0 + 0.5f * (chunk->w - 1)) * pitch, (chunk->y0 + 0.5f * (chunk->h - 1)) * pitch, 0.0f);
+			vec3 d = center - cameraInModel;
+			return dot(d, d);
+		};
+		std::sort(visibleChunks.begin(), visibleChunks.end(), [&](const VisibleChunk& a, const VisibleChunk& b) { return distanceToCamera(a) < distanceToCamera(b); });
+	}
+
+	std::fill(std::begin(lodTileCounts), std::end(lodTileCounts), 0);
+	for (VisibleChunk& visible : visibleChunks) {
+		chooseChunkLod(visible, cameraInModel, projection);
+		lodTileCounts[visible.lod]++;
+	}
+	drawnTiles = (int)visibleChunks.size();
+}
+
+void prepareCubeChunks()
+{
+	cubeChunks.clear();
+	chunksX = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunksY = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	for (int y0 = 0; y0 < height; y0 += CHUNK_SIZE) {
+		for (int x0 = 0; x0 < width; x0 += CHUNK_SIZE) {
+			CubeChunk chunk = {};
+			chunk.x0 = x0;
+			chunk.y0 = y0;
+			chunk.w = std::min(CHUNK_SIZE, width - x0);
+			chunk.h = std::min(CHUNK_SIZE, height - y0);
+			cubeChunks.push_back(chunk);
+		}
+	}
+
+	chunkQuadtree.clear();
+	if (!cubeChunks.empty())
+		buildQuadtree(0, 0, chunksX, chunksY);
+}
+
+// instanced path: all cubes share one indexed cube mesh, everything that differs per cube lives in a compact instance buffer
+// -------------------------------------------------
+struct CubeInstance
+{
+	GLushort x, y;       // grid cell, or block of cells on coarser pyramid levels (location = 4)
+	GLubyte r, g, b, a;  // color, normalized to [0,1] by the attribute pointer (location = 3)
+	GLubyte pr, pg, pb, pa; // color of the block on the next coarser level, to blend between levels (location = 5)
+};
+
+unsigned int instancedCubeVAO = 0;
+unsigned int instanceVBO = 0;
+constexpr int instancedCubeIndexCount = 36;
+
+// points the per-instance attributes at the given first instance (GL 3.3 has no base instance for draw calls)
+void bindInstanceRange(GLint firstInstance)
+{
+	size_t offset = firstInstance * sizeof(CubeInstance);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	glVertexAttribPointer(3, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CubeInstance), (void*)(offset + offsetof(CubeInstance, r)));
+	glVertexAttribPointer(4, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(CubeInstance), (void*)(offset + offsetof(CubeInstance, x)));
+	glVertexAttribPointer(5, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CubeInstance), (void*)(offset + offsetof(CubeInstance, pr)));
+}
+
+void prepareInstancedCubes()
+{
+	// 4 vertices per face (position, normal, uv), faces wind counter-clockwise when seen from outside
+	float vertices[] = {
+		// Back face
+		1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f,
+		-1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f,
+		-1.0f, 1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f,
+		1.0f, 1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f,
+		// Front face
+		-1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+		1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f,
+		1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f,
+		-1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f,
+		// Left face
+		-1.0f, -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+		-1.0f, -1.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+		-1.0f, 1.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
+		-1.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+		// Right face
+		1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+		1.0f, -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+		1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
+		1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+		// Bottom face
+		-1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+		1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f,
+		1.0f, -1.0f, 1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 1.0f,
+		-1.0f, -1.0f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f,
+		// Top face
+		-1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f,
+		1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+		1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f,
+		-1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f
+	};
+
+	GLushort indices[instancedCubeIndexCount];
+	for (int face = 0; face < 6; ++face) {
+		GLushort first = (GLushort)(face * 4);
+		GLushort quad[6] = { first, (GLushort)(first + 1), (GLushort)(first + 2), (GLushort)(first + 2), (GLushort)(first + 3), first };
+		for (int i = 0; i < 6; ++i)
+			indices[face * 6 + i] = quad[i];
+	}
+
+	// instances are stored level by level and within a level chunk by chunk, so every chunk can be drawn on its own
+	// at any level of the pyramid (chunks start at multiples of CHUNK_SIZE, so their blocks never straddle two chunks)
+	std::vector<CubeInstance> instances;
+	instances.reserve(width * height * 4 / 3 + cubeChunks.size() * LOD_LEVELS);
+	for (int level = 0; level < LOD_LEVELS; ++level) {
+		const ImageLevel& pixels = imagePyramid[level];
+		const ImageLevel& parent = imagePyramid[std::min(level + 1, LOD_LEVELS - 1)];
+		for (CubeChunk& chunk : cubeChunks) {
+			chunk.firstInstance[level] = (GLint)instances.size();
+			for (int y = chunk.y0 >> level; y <= (chunk.y0 + chunk.h - 1) >> level; ++y) {
+				for (int x = chunk.x0 >> level; x <= (chunk.x0 + chunk.w - 1) >> level; ++x) {
+					const unsigned char* color = &pixels.rgb[(y * pixels.width + x) * colorComponentsPerVertex];
+					int px = level + 1 < LOD_LEVELS ? x / 2 : x, py = level + 1 < LOD_LEVELS ? y / 2 : y;
+					const unsigned char* parentColor = &parent.rgb[(py * parent.width + px) * colorComponentsPerVertex];
+					CubeInstance instance;
+					instance.x = (GLushort)x;
+					instance.y = (GLushort)y;
+					instance.r = color[0];
+					instance.g = color[1];
+					instance.b = color[2];
+					instance.a = 255;
+					instance.pr = parentColor[0];
+					instance.pg = parentColor[1];
+					instance.pb = parentColor[2];
+					instance.pa = 255;
+					instances.push_back(instance);
+				}
+			}
+			chunk.instanceCount[level] = (GLsizei)(instances.size() - chunk.firstInstance[level]);
+		}
+	}
+
+	GLuint meshVBO, meshEBO;
+	glGenVertexArrays(1, &instancedCubeVAO);
+	glGenBuffers(1, &meshVBO);
+	glGenBuffers(1, &meshEBO);
+	glGenBuffers(1, &instanceVBO);
+
+	glBindVertexArray(instancedCubeVAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+	// Positions (location = 0), Normals (location = 1), UVs (location = 2)
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+
+	// Colors (location = 3), grid cells (location = 4) and parent colors (location = 5) advance once per instance
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(CubeInstance), instances.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(3);
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(4);
+	glVertexAttribDivisor(4, 1);
+	glEnableVertexAttribArray(5);
+	glVertexAttribDivisor(5, 1);
+	bindInstanceRange(0);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	CubePathStats& stats = cubePathStats[INSTANCED];
+	stats.bufferCount = 3;
+	stats.gpuBytes = sizeof(vertices) + sizeof(indices) + instances.size() * sizeof(CubeInstance);
+}
+
+// draws the instances of one visible chunk at its pyramid level
+void drawChunkInstances(const VisibleChunk& visible, CubePathStats& stats)
+{
+	drawUniforms->bind(visible.drawBlock);
+	bindInstanceRange(visible.chunk->firstInstance[visible.lod]);
+	glDrawElementsInstanced(GL_TRIANGLES, instancedCubeIndexCount, GL_UNSIGNED_SHORT, 0, visible.chunk->instanceCount[visible.lod]);
+	stats.drawCalls++;
+	stats.triangles += (size_t)visible.chunk->instanceCount[visible.lod] * instancedCubeIndexCount / 3;
+}
+
+void renderInstancedCubes()
+{
+	CubePathStats& stats = cubePathStats[INSTANCED];
+	glBindVertexArray(instancedCubeVAO);
+	if (!tileCulling && !distanceLod) {
+		drawUniforms->bind(wallBlock);
+		bindInstanceRange(0);
+		glDrawElementsInstanced(GL_TRIANGLES, instancedCubeIndexCount, GL_UNSIGNED_SHORT, 0, width * height);
+		stats.drawCalls = 1;
+		stats.triangles = (size_t)width * height * instancedCubeIndexCount / 3;
+	}
+	else {
+		stats.drawCalls = 0;
+		stats.triangles = 0;
+		for (const VisibleChunk& visible : visibleChunks)
+			drawChunkInstances(visible, stats);
+	}
+	glBindVertexArray(0);
+}
+
+// merged path: while the wall is flat, back faces and side faces hidden by neighbors are dropped and same colored
+// front faces are merged into rectangles (greedy meshing). Chunks the ripple reaches are drawn as instanced cubes.
+// -------------------------------------------------
+struct FlatVertex
+{
+	float x, y, z;         // position in model space (location = 0)
+	GLbyte nx, ny, nz, pad; // normal (location = 1)
+	GLubyte r, g, b, a;    // color (location = 3)
+};
+
+unsigned int mergedCubeVAO = 0;
+
+void appendQuad(std::vector<FlatVertex>& vertices, std::vector<GLuint>& indices, const vec3 corners[4], const vec3& normal, const unsigned char* color)
+{
+	GLuint first = (GLuint)vertices.size();
+	for (int i = 0; i < 4; ++i) {
+		FlatVertex v;
+		v.x = corners[i].x;
+		v.y = corners[i].y;
+		v.z = corners[i].z;
+		v.nx = (GLbyte)(normal.x * 127.0f);
+		v.ny = (GLbyte)(normal.y * 127.0f);
+		v.nz = (GLbyte)(normal.z * 127.0f);
+		v.pad = 0;
+		v.r = color[0];
+		v.g = color[1];
+		v.b = color[2];
+		v.a = 255;
+		vertices.push_back(v);
+	}
+	GLuint quad[6] = { first, first + 1, first + 2, first + 2, first + 3, first };
+	indices.insert(indices.end(), quad, quad + 6);
+}
+
+// greedy meshing of one chunk: grows rectangles of equal color first along x, then along y. With gaps between the cubes
+// a rectangle would cover the gaps, so every cube keeps its own front and side faces and only the back faces are dropped
+void appendMergedChunk(CubeChunk& chunk, std::vector<FlatVertex>& vertices, std::vector<GLuint>& indices)
+{
+	const float pitch = 2.0f + DISTANCE_BETWEEN_CUBES;
+	const bool gaps = DISTANCE_BETWEEN_CUBES > 0;
+	auto color = [](int x, int y) { return &image[(y * width + x) * colorComponentsPerVertex]; };
+	auto sameColor = [&](int x0, int y0, int x1, int y1) { return std::equal(color(x0, y0), color(x0, y0) + 3, color(x1, y1)); };
+
+	chunk.firstIndex = indices.size();
+	std::vector<bool> merged(chunk.w * chunk.h, false);
+	for (int y = chunk.y0; y < chunk.y0 + chunk.h; ++y) {
+		for (int x = chunk.x0; x < chunk.x0 + chunk.w; ++x) {
+			if (merged[(y - chunk.y0) * chunk.w + (x - chunk.x0)])
+				continue;
+
+			int rw = 1;
+			while (!gaps && x + rw < chunk.x0 + chunk.w && !merged[(y - chunk.y0) * chunk.w + (x + rw - chunk.x0)] && sameColor(x, y, x + rw, y))
+				rw++;
+			int rh = 1;
+			bool rowMatches = true;
+			while (!gaps && rowMatches && y + rh < chunk.y0 + chunk.h) {
+				for (int i = 0; i < rw && rowMatches; ++i)
+					rowMatches = !merged[(y + rh - chunk.y0) * chunk.w + (x + i - chunk.x0)] && sameColor(x, y, x + i, y + rh);
+				if (rowMatches)
+					rh++;
+			}
+			for (int j = 0; j < rh; ++j)
+				for (int i = 0; i < rw; ++i)
+					merged[(y + j - chunk.y0) * chunk.w + (x + i - chunk.x0)] = true;
+
+			const unsigned char* c = color(x, y);
+			float xa = x * pitch - 1.0f, xb = (x + rw - 1) * pitch + 1.0f;
+			float ya = y * pitch - 1.0f, yb = (y + rh - 1) * pitch + 1.0f;
+
+			// front face of the whole rectangle
+			vec3 front[4] = { vec3(xa, ya, 1.0f), vec3(xb, ya, 1.0f), vec3(xb, yb, 1.0f), vec3(xa, yb, 1.0f) };
+			appendQuad(vertices, indices, front, vec3(0.0f, 0.0f, 1.0f), c);
+
+			// side faces: without gaps only the ones on the chunk border can be seen (the neighboring chunk may ripple),
+			// with gaps every cube shows its sides
+			if (gaps || x == chunk.x0) {
+				vec3 left[4] = { vec3(xa, ya, -1.0f), vec3(xa, ya, 1.0f), vec3(xa, yb, 1.0f), vec3(xa, yb, -1.0f) };
+				appendQuad(vertices, indices, left, vec3(-1.0f, 0.0f, 0.0f), c);
+			}
+			if (gaps || x + rw == chunk.x0 + chunk.w) {
+				vec3 right[4] = { vec3(xb, ya, 1.0f), vec3(xb, ya, -1.0f), vec3(xb, yb, -1.0f), vec3(xb, yb, 1.0f) };
+				appendQuad(vertices, indices, right, vec3(1.0f, 0.0f, 0.0f), c);
+			}
+			if (gaps || y == chunk.y0) {
+				vec3 bottom[4] = { vec3(xa, ya, -1.0f), vec3(xb, ya, -1.0f), vec3(xb, ya, 1.0f), vec3(xa, ya, 1.0f) };
+				appendQuad(vertices, indices, bottom, vec3(0.0f, -1.0f, 0.0f), c);
+			}
+			if (gaps || y + rh == chunk.y0 + chunk.h) {
+				vec3 top[4] = { vec3(xa, yb, 1.0f), vec3(xb, yb, 1.0f), vec3(xb, yb, -1.0f), vec3(xa, yb, -1.0f) };
+				appendQuad(vertices, indices, top, vec3(0.0f, 1.0f, 0.0f), c);
+			}
+		}
+	}
+	chunk.indexCount = (GLsizei)(indices.size() - chunk.firstIndex);
+}
+
+void prepareMergedCubes()
+{
+	std::vector<FlatVertex> vertices;
+	std::vector<GLuint> indices;
+	for (CubeChunk& chunk : cubeChunks)
+		appendMergedChunk(chunk, vertices, indices);
+
+	GLuint VBO, EBO;
+	glGenVertexArrays(1, &mergedCubeVAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+
+	glBindVertexArray(mergedCubeVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(FlatVertex), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+	// Positions (location = 0), Normals (location = 1) and Colors (location = 3); the grid cell (location = 4)
+	// stays disabled and reads as zero, because the positions are already placed on the wall
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(FlatVertex), (void*)offsetof(FlatVertex, x));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_BYTE, GL_TRUE, sizeof(FlatVertex), (void*)offsetof(FlatVertex, nx));
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(FlatVertex), (void*)offsetof(FlatVertex, r));
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	CubePathStats& stats = cubePathStats[MERGED];
+	stats.bufferCount = 2;
+	stats.gpuBytes = vertices.size() * sizeof(FlatVertex) + indices.size() * sizeof(GLuint);
+	std::cout << "(" << indices.size() / 3 << " merged triangles instead of " << (size_t)width * height * 12 << ") ";
+}
+
+// a chunk ripples if any of its cells was displaced in the last simulation step
+bool chunkInRipple(const CubeChunk& chunk)
+{
+	return ripplesEnabled && heightfield->tileMaxHeight(chunk.x0 / CHUNK_SIZE, chunk.y0 / CHUNK_SIZE) > flatThreshold;
+}
+
+void renderMergedCubes(Shader& shader, Shader& flatShader, const mat4& projection, const mat4& view, const mat4& model)
+{
+	CubePathStats& stats = cubePathStats[MERGED];
+	stats.drawCalls = 0;
+	stats.triangles = 0;
+
+	// the merged mesh has no back faces, so it only works while the camera is in front of the wall
+	vec3 cameraInModel = vec3(inverse(model) * vec4(cameraPos, 1.0f));
+	if (cameraInModel.z <= 1.0f) {
+		renderInstancedCubes();
+		stats.drawCalls = cubePathStats[INSTANCED].drawCalls;
+		stats.triangles = cubePathStats[INSTANCED].triangles;
+		return;
+	}
+
+	// walk the visible chunks front to back; consecutive flat chunks are batched into one multi draw
+	std::vector<GLsizei> flatCounts;
+	std::vector<const void*> flatOffsets;
+	auto flushFlatChunks = [&]() {
+		if (flatCounts.empty())
+			return;
+		flatShader.use();
+		drawUniforms->bind(wallBlock);
+		glBindVertexArray(mergedCubeVAO);
+		glVertexAttrib3f(4, 0.0f, 0.0f, 0.0f);
+		glMultiDrawElements(GL_TRIANGLES, flatCounts.data(), GL_UNSIGNED_INT, flatOffsets.data(), (GLsizei)flatCounts.size());
+		shader.use();
+		stats.drawCalls++;
+		flatCounts.clear();
+		flatOffsets.clear();
+	};
+
+	for (const VisibleChunk& visible : visibleChunks) {
+		const CubeChunk* chunk = visible.chunk;
+		// the merged mesh is the same geometry as unblended level 0 cubes, so only those tiles swap to it; tiles that are
+		// coarser or morphing towards level 1 stay cubes, which keeps every LOD transition blended instead of popping
+		bool coarser = visible.lod > 0 || visible.blend > 0.0f;
+		if (chunkInRipple(*chunk) || coarser) {
+			flushFlatChunks();
+			glBindVertexArray(instancedCubeVAO);
+			drawChunkInstances(visible, stats);
+		}
+		else {
+			flatCounts.push_back(chunk->indexCount);
+			flatOffsets.push_back((const void*)(chunk->firstIndex * sizeof(GLuint)));
+			stats.triangles += chunk->indexCount / 3;
+		}
+	}
+	flushFlatChunks();
+	glBindVertexArray(0);
+}
+
+// intersects the ray through the mouse with the front of the wall and returns the (fractional) grid cell that was hit
+bool pickWallCell(const mat4& projection, const mat4& view, const mat4& model, vec2& cell)
+{
+	mat4 inverseMVP = inverse(projection * view * model);
+	vec4 nearPoint = inverseMVP * vec4(mousePos, -1.0f, 1.0f);
+	vec4 farPoint = inverseMVP * vec4(mousePos, 1.0f, 1.0f);
+	vec3 origin = vec3(nearPoint) / nearPoint.w;
+	vec3 direction = vec3(farPoint) / farPoint.w - origin;
+	if (std::abs(direction.z) < 1e-6f)
+		return false;
+	float t = (1.0f - origin.z) / direction.z;
+	if (t < 0.0f)
+		return false;
+	vec3 hit = origin + t * direction;
+	cell = vec2(hit.x, hit.y) / (2.0f + DISTANCE_BETWEEN_CUBES);
+	return cell.x > -0.5f && cell.y > -0.5f && cell.x < width - 0.5f && cell.y < height - 0.5f;
+}
+
+// moves the ripple under the mouse, starts a new one per click, advances the simulation and uploads the heights
+void updateRipples(const mat4& projection, const mat4& view, const mat4& model)
+{
+	vec2 cell;
+	if (pickWallCell(projection, view, model, cell)) {
+		heightfield->setHoverSource(cell, hoverAmplitude);
+		if (mouseClicked)
+			heightfield->addRipple(cell, clickAmplitude);
+	}
+	else {
+		heightfield->clearHoverSource();
+	}
+	mouseClicked = false;
+
+	auto t1 = std::chrono::high_resolution_clock::now();
+	int steps = heightfield->update(deltaTime);
+	auto t2 = std::chrono::high_resolution_clock::now();
+	simulationMs = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.0f;
+
+	if (steps > 0) {
+		glBindTexture(GL_TEXTURE_2D, heightMapTexture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_FLOAT, heightfield->data());
+	}
+}
+
+// renders the cube wall with the selected path, the path is created on first use and its startup time is recorded
+// -------------------------------------------------
+void prepareCubePath(int mode)
+{
+	CubePathStats& stats = cubePathStats[mode];
+	if (stats.prepared)
+		return;
+
+	std::cout << "Preparing " << cubeRenderModeNames[mode] << " cube wall ... ";
+	auto t1 = std::chrono::high_resolution_clock::now();
+	if (mode == PER_CUBE)
+		prepareCubes();
+	else if (mode == INSTANCED)
+		prepareInstancedCubes();
+	else
+		prepareMergedCubes();
+	glFinish(); // include the upload in the measurement
+	auto t2 = std::chrono::high_resolution_clock::now();
+	stats.prepareMs = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.0f;
+	stats.prepared = true;
+	std::cout << "done (in " << stats.prepareMs << " milliseconds)." << std::endl;
+}
+
+// flatShader is the variant for the merged faces of flat tiles and only needed in merged mode
+void renderCubeWall(Shader& shader, Shader* flatShader, const mat4& projection, const mat4& view, const mat4& model)
+{
+	shader.use();
+	if (cubeRenderMode == MERGED)
+		prepareCubePath(INSTANCED); // the rippling chunks are drawn as instanced cubes
+	prepareCubePath(cubeRenderMode);
+
+	if (cubeRenderMode != PER_CUBE)
+		collectVisibleChunks(projection, view, model);
+
+	// the per-draw uniforms of the whole wall are staged first and uploaded at once
+	wallBlock = stageWallDraw(1.0f, 0.0f);
+	if (cubeRenderMode != PER_CUBE)
+		for (VisibleChunk& visible : visibleChunks)
+			visible.drawBlock = stageWallDraw((float)(1 << visible.lod), visible.blend);
+	drawUniforms->upload();
+
+	if (cubeRenderMode == PER_CUBE)
+		renderCubes();
+	else if (cubeRenderMode == INSTANCED)
+		renderInstancedCubes();
+	else
+		renderMergedCubes(shader, *flatShader, projection, view, model);
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -466,6 +1352,8 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	if (width > 0 && height > 0)
 	{
 		glViewport(0, 0, width, height);
+		WIDTH = width; // the LOD selection needs the size of the viewport
+		HEIGHT = height;
 	}
 }
 
@@ -487,6 +1375,8 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 // ----------------------------------------------------------------------
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+		mouseClicked = true;
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
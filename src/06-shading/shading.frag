@@ -7,32 +7,25 @@ in vec2 texCoord;
 in vec3 fragPos;
 in vec3 vColor;
 
-uniform vec3 lightPos;
-uniform vec3 cameraPos;
+#include "uniforms.glsl"
+#include "lighting.glsl"
+
+// features and constants are baked in as defines (see ShaderVariants in shading.cpp):
+//   OBJECT_COLOR  one color for all cubes instead of the image colors
+#ifdef OBJECT_COLOR
+uniform vec3 objectColor;
+#endif
 uniform sampler2D texture_diffuse1;
 
 void main()
-{   
-	vec3 lightColor = vec3(1.0, 1.0, 1.0);
-
-	// ambient
-	float ambientStrength = 0.1;
-	vec3 ambient = ambientStrength * lightColor;
-
-	// diffuse 
+{
 	vec3 nnormal = normalize(normal);
-	vec3 lightDir = normalize(lightPos - fragPos);
-	float angle = max(dot(nnormal, lightDir), 0.0);
-	vec3 diffuse = angle * lightColor;
-
-	// specular
-	float specularStrength = 1.0;
-	vec3 viewDir = normalize(cameraPos - fragPos);
-	vec3 reflectDir = reflect(-lightDir, nnormal);
-	float specFactor = pow(max(dot(viewDir, reflectDir), 0.0), 1);
-	vec3 specular = specularStrength * specFactor * lightColor;
 
-	vec3 result = (ambient + diffuse + specular);
+	vec3 result = phongLighting(nnormal, fragPos, lightPos.xyz, cameraPos.xyz);
 
+#ifdef OBJECT_COLOR
+	fragColor = vec4(objectColor * result, 1.0);
+#else
 	fragColor = vec4(vColor, 1.0) * vec4(result, 1.0);
-}
\ No newline at end of file
+#endif
+}
@@ -3,45 +3,46 @@ layout (location = 0) in vec3 aPosition;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aUV;
 layout (location = 3) in vec3 aColor;
-layout (location = 4) in vec3 aOffset;
+layout (location = 4) in vec3 aOffset; // grid cell of the cube, or block of cellSize x cellSize cells
+layout (location = 5) in vec3 aParentColor; // color of the block on the next coarser level
 
 out vec2 texCoord;
 out vec3 normal;
 out vec3 fragPos;
 out vec3 vColor;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "uniforms.glsl"
 
-uniform vec2 mousePos;
-uniform float time;
+// features and constants are baked in as defines (see ShaderVariants in shading.cpp):
+//   RIPPLES     displaces every cube by the height of its cell
+//   GRID_PITCH  distance between the centers of two neighboring cubes
+#ifdef RIPPLES
+uniform sampler2D heightMap; // ripple heights simulated on the CPU, one texel per cell, texture unit 0
+#endif
 
 void main()
 {
-	vColor = aColor; // Pass color to fragment shader
+	vColor = mix(aColor, aParentColor, lodBlend); // Pass color to fragment shader
     texCoord = aUV;   
-	normal	 = mat3(transpose(inverse(model))) * aNormal;
+	normal	 = mat3(normalMatrix) * aNormal;
 
 	// Vertex position calculation in world space
-	vec3 finalDestination = aPosition + aOffset;
+	// a cube of a coarser level covers its whole block, minus the gap to the next block; with lodBlend the cube grows
+	// towards the block of the next coarser level, so the geometry morphs along with the color instead of popping
+	float parentSize = 2.0 * cellSize;
+	vec2 parentOffset = floor(aOffset.xy * 0.5);
+	float halfExtent = mix(0.5 * (GRID_PITCH * cellSize - (GRID_PITCH - 2.0)), 0.5 * (GRID_PITCH * parentSize - (GRID_PITCH - 2.0)), lodBlend);
+	vec2 center = mix((aOffset.xy * cellSize + 0.5 * (cellSize - 1.0)) * GRID_PITCH,
+	                  (parentOffset * parentSize + 0.5 * (parentSize - 1.0)) * GRID_PITCH, lodBlend);
+	vec3 finalDestination = vec3(aPosition.xy * halfExtent + center, aPosition.z + aOffset.z);
+
+#ifdef RIPPLES
+	// move the whole cube along the z-axis by the height of its cell (the center cell for blocks of a coarser level)
+	ivec2 cell = clamp(ivec2(aOffset.xy * cellSize) + ivec2(int(cellSize) / 2), ivec2(0), textureSize(heightMap, 0) - 1);
+	finalDestination.z += texelFetch(heightMap, cell, 0).r;
+#endif
 	fragPos  = vec3(model * vec4(finalDestination, 1.0));
 
-	// Transform to clip space...
-    vec4 clipSpacePosition = projection * view * model * vec4(finalDestination, 1.0);
-
-	// ...and to normalized device coordinates so that it matches the mouse pos space
-    vec2 fragPositionNDC = clipSpacePosition.xy / clipSpacePosition.w;
-
-    // Calculate distance between vertex and mouse position in NDC space and move the vertex along z-axis based on time
-    float frequencyBoost = 20; // changes wave length
-    float vertexMouseDistance = distance(mousePos, fragPositionNDC);
-    float speed = 2; // changes wave speed
-    float timeBasedDistance = vertexMouseDistance * frequencyBoost - time * speed;
-    float waveFriction = 75; // decreases wave amplitude with distance
-    float amplitude = max(50 - vertexMouseDistance * waveFriction, 0); // changes wave height
-    finalDestination.z += abs(sin(timeBasedDistance) * amplitude);
-
     // Actual final vertex position
     gl_Position = projection * view * model * vec4(finalDestination, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,23 @@
+// uniform blocks shared by all stages, see FrameUniforms/DrawUniforms in util/shader.h
+
+// shared by all programs, updated once per frame (binding 0)
+layout (std140) uniform FrameUniforms
+{
+	mat4 projection;
+	mat4 view;
+	vec4 cameraPos;
+	vec4 lightPos;
+	vec2 mousePos;
+	float time;
+};
+
+// per draw call, taken from a ring buffer (binding 1); has to match CubeDrawUniforms in shading.cpp
+layout (std140) uniform DrawUniforms
+{
+	mat4 model;
+	mat4 normalMatrix; // transpose(inverse(model)), computed once on the CPU
+	vec4 positionScale; // map quantized mesh positions back, unused by the cubes
+	vec4 positionOffset;
+	float cellSize; // cells covered by one cube along x and y (1 unless a coarser level is drawn)
+	float lodBlend; // morphs color and size towards the next coarser level so level switches don't pop
+};
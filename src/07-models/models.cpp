@@ -0,0 +1,274 @@
+#include <glad/glad.h>
+#include <glfw/glfw3.h>
+#include <iostream>
+#include <string>
+#include <memory>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <util/assets.h>
+#include <util/shader.h>
+#include <util/camera.h>
+#include <util/model.h>
+#include <util/renderqueue.h>
+#include <util/window.h>
+
+using namespace glm;
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void processInput(GLFWwindow* window);
+
+int WIDTH = 800;
+int HEIGHT = 600;
+
+Camera camera(vec3(0.0f, 3.0f, 14.0f));
+
+// timing
+float deltaTime = 0.0f;
+float lastFrame = 0.0f;
+
+vec3 lightPos = vec3(6.0f, 10.0f, 12.0f);
+
+const char* APP_NAME = "models";
+
+const char* MODEL_PATH = "../resources/models/shapes.obj";
+
+// the model and its texture are streamed in by the AssetManager, placeholders are drawn until they are ready
+Assets assets = {
+	{ "shapes", {
+		{ "model", MODEL_PATH },
+		{ "texture", "../resources/images/klein.jpg" } } }
+};
+
+// the copies of the model are either queued, sorted and drawn with their level of detail, or drawn one by one with
+// the meshlets outside the frustum or facing away culled
+enum RenderMode
+{
+	QUEUED,
+	CULLED,
+	RENDER_MODE_COUNT
+};
+const char* renderModeNames[RENDER_MODE_COUNT] = { "render queue, levels of detail", "direct, culled meshlets" };
+int renderMode = QUEUED;
+int gridSize = 5;               // copies of the model per side
+constexpr int MAX_GRID_SIZE = 16;
+constexpr float GRID_SPACING = 5.0f;
+
+// the AssetManager loads models without their textures; with texture arrays the model is loaded once more with its
+// textures as layers of texture arrays (see Model::useTextureArrays), which the shader samples at <sampler>Layer
+bool useTextureArrays = false;
+
+ShaderDefines modelShaderFeatures(bool queued)
+{
+	ShaderDefines features;
+	if (queued)
+		features["DRAW_UNIFORM_BLOCK"] = "";
+	if (useTextureArrays)
+		features["TEXTURE_ARRAYS"] = "";
+	return features;
+}
+
+int main()
+{
+	InitWindowAndGUI(WIDTH, HEIGHT, APP_NAME);
+	SetFramebufferSizeCallback(framebuffer_size_callback);
+
+	// the same sources for both paths: the queue passes the matrices in the DrawUniforms block, direct draws as plain
+	// uniforms; each variant is compiled on first use, see modelShaderFeatures()
+	ShaderVariants modelShaders("../src/07-models/models.vert", "../src/07-models/models.frag", "", { { "SPECULAR_EXPONENT", "32" } });
+	std::unique_ptr<Model> arrayModel;
+	glm::vec4 bgColor = { 0.1, 0.1, 0.1, 1.0 };
+
+	AssetManager assetManager(assets);
+	AssetHandle<Model> shapes = assetManager.GetModelAsync("shapes", "model");
+	AssetHandle<Tex> texture = assetManager.GetTextureAsync("shapes", "texture");
+	float loadStart = (float)glfwGetTime();
+	float modelLoadSeconds = 0.0f, textureLoadSeconds = 0.0f;
+	shapes.onReady([&](Model&) { modelLoadSeconds = (float)glfwGetTime() - loadStart; });
+	texture.onReady([&](Tex&) { textureLoadSeconds = (float)glfwGetTime() - loadStart; });
+
+	// one block per draw call of the queue, the ring grows if the grid takes more
+	RenderQueue queue;
+	UniformBuffer frameUniforms(FRAME_UNIFORMS_BINDING, sizeof(FrameUniforms));
+	UniformRing drawUniforms(DRAW_UNIFORMS_BINDING, sizeof(DrawUniforms), 2 * gridSize * gridSize);
+	float lodThreshold = 1.0f;
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+
+	// Main Loop
+	while (!glfwWindowShouldClose(window))
+	{
+
+		float currentFrame = (float)glfwGetTime();
+		deltaTime = currentFrame - lastFrame;
+		lastFrame = currentFrame;
+
+		processInput(window);
+
+		// finishes the background loads a slice at a time, the handles switch from their placeholders once done
+		assetManager.UpdateStreaming();
+		if (useTextureArrays && !arrayModel)
+			arrayModel = std::make_unique<Model>(MODEL_PATH, true, false, false, false, true, true);
+		Model& model = useTextureArrays ? *arrayModel : shapes.get();
+		model.lodThreshold = lodThreshold;
+		Shader& queuedShader = modelShaders.get(modelShaderFeatures(true));
+		Shader& directShader = modelShaders.get(modelShaderFeatures(false));
+
+		mat4 projection = perspective(radians(camera.Zoom), (float)WIDTH / (float)HEIGHT, 0.1f, 200.0f);
+		mat4 view = camera.GetViewMatrix();
+
+		glClearColor(bgColor.r, bgColor.g, bgColor.b, bgColor.a);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+		FrameUniforms frame = {};
+		frame.projection = projection;
+		frame.view = view;
+		frame.cameraPos = vec4(camera.Position, 1.0f);
+		frame.lightPos = vec4(lightPos, 1.0f);
+		frame.time = currentFrame;
+		frameUniforms.update(frame);
+
+		// the streamed model has no textures of its own, so nothing rebinds unit 0
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, texture.get());
+
+		MeshletStats meshletStats;
+		int lodCounts[Model::MAX_LODS] = {};
+		queue.beginFrame();
+		drawUniforms.beginFrame();
+		if (renderMode == CULLED)
+			directShader.use();
+		for (int y = 0; y < gridSize; y++)
+		{
+			for (int x = 0; x < gridSize; x++)
+			{
+				vec3 offset = GRID_SPACING * vec3(x - 0.5f * (gridSize - 1), 0.0f, -y);
+				mat4 transform = rotate(translate(mat4(1.0f), offset), 0.3f * currentFrame + x + y, vec3(0.0f, 1.0f, 0.0f));
+				if (renderMode == QUEUED)
+				{
+					model.Draw(queue, queuedShader, camera, transform, (float)HEIGHT);
+					for (const Mesh& mesh : model.meshes)
+						lodCounts[std::min(model.selectLod(mesh, camera, transform, (float)HEIGHT), Model::MAX_LODS - 1)]++;
+					continue;
+				}
+				directShader.setMat4("model", transform);
+				directShader.setMat4("normalMatrix", DrawUniforms(transform).normalMatrix);
+				MeshletStats stats = model.DrawCulled(directShader, projection, view, transform, camera.Position);
+				meshletStats.tested += stats.tested;
+				meshletStats.outsideFrustum += stats.outsideFrustum;
+				meshletStats.backFacing += stats.backFacing;
+				meshletStats.drawn += stats.drawn;
+				meshletStats.ranges += stats.ranges;
+			}
+		}
+		queue.flush(&drawUniforms);
+		drawUniforms.endFrame();
+
+		// START: UI-Stuff
+		if (gui)
+		{
+			// Start the Dear ImGui frame
+			ImGui_ImplOpenGL3_NewFrame();
+			ImGui_ImplGlfw_NewFrame();
+			ImGui::NewFrame();
+
+			{
+				ImGui::Begin(APP_NAME);
+				ImGui::ColorEdit3("clear color", (float*)&bgColor.x);
+				ImGui::Text("FPS: %.1f", ImGui::GetIO().Framerate); // show framerate
+				ImGui::Combo("render path", &renderMode, renderModeNames, RENDER_MODE_COUNT);
+				ImGui::SliderInt("copies per side", &gridSize, 1, MAX_GRID_SIZE);
+				ImGui::Checkbox("model textures as texture arrays", &useTextureArrays);
+				if (useTextureArrays && arrayModel)
+					ImGui::Text("texture arrays: %zu, textures sharing an array: %zu", arrayModel->textureArrays.size(),
+						arrayModel->texturesInArrays);
+
+				if (renderMode == QUEUED)
+				{
+					const RenderQueue::Stats& stats = queue.getStats();
+					ImGui::Text("queue: %zu meshes in %zu draw calls", stats.draws, stats.drawCalls);
+					ImGui::Text("program binds: %zu, skipped: %zu", stats.programBinds, stats.programsSkipped);
+					ImGui::Text("texture binds: %zu, skipped: %zu", stats.textureBinds, stats.texturesSkipped);
+					ImGui::Text("vertex array binds: %zu, skipped: %zu", stats.vertexArrayBinds, stats.vertexArraysSkipped);
+					ImGui::Text("per-draw uniform blocks: %d, frames stalled on the ring: %d, grown: %d", drawUniforms.stagedBlocks(),
+						drawUniforms.stalledFrames(), drawUniforms.growths());
+					ImGui::SliderFloat("LOD pixel error", &lodThreshold, 0.25f, 16.0f);
+					ImGui::Text("meshes per LOD: %d / %d / %d / %d / %d", lodCounts[0], lodCounts[1], lodCounts[2], lodCounts[3], lodCounts[4]);
+				}
+				else
+				{
+					ImGui::Text("meshlets: %zu tested, %zu outside the frustum, %zu facing away", meshletStats.tested,
+						meshletStats.outsideFrustum, meshletStats.backFacing);
+					ImGui::Text("meshlets drawn: %zu in %zu index ranges", meshletStats.drawn, meshletStats.ranges);
+				}
+
+				// the model cache turns the second start into a plain upload from a memory mapped file
+				if (shapes.isReady() || useTextureArrays)
+				{
+					const Model::LoadTimes& times = model.loadTimes;
+					if (times.fromCache)
+						ImGui::Text("model: from the model cache, upload %.1f ms", times.upload);
+					else
+						ImGui::Text("model: imported, parse %.1f ms, convert %.1f ms, upload %.1f ms", times.parse, times.convert, times.upload);
+					ImGui::Text("model ready after %.2f s, texture after %.2f s", modelLoadSeconds, textureLoadSeconds);
+				}
+				else
+					ImGui::Text("model: %s", shapes.state() == AssetState::Failed ? "failed, showing the placeholder" : "streaming ...");
+
+				const AssetCache::Stats& cache = assetManager.GetCacheStats();
+				ImGui::Text("streaming: %zu assets pending", assetManager.GetStreamer().pendingCount());
+				ImGui::Text("asset cache: %zu entries, %zu hits, %zu misses, %zu evictions", cache.entries, cache.hits, cache.misses,
+					cache.evictions);
+				ImGui::Text("asset memory: %.2f MB GPU, %.2f MB CPU", cache.gpuBytes / (1024.0f * 1024.0f), cache.cpuBytes / (1024.0f * 1024.0f));
+				ImGui::End();
+			}
+			ImGui::Render();
+		}
+		// END: UI-Stuff
+
+		if (gui)
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		glfwSwapBuffers(window);
+		glfwPollEvents();
+	}
+
+	DestroyWindow();
+	return 0;
+}
+
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// ---------------------------------------------------------------------------------------------------------
+void processInput(GLFWwindow* window)
+{
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+		glfwSetWindowShouldClose(window, true);
+
+	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+		camera.ProcessKeyboard(FORWARD, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+		camera.ProcessKeyboard(BACKWARD, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+		camera.ProcessKeyboard(LEFT, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+		camera.ProcessKeyboard(RIGHT, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+		camera.ProcessMouseMovement(-200.0f * deltaTime / camera.MouseSensitivity, 0.0f);
+	if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+		camera.ProcessMouseMovement(200.0f * deltaTime / camera.MouseSensitivity, 0.0f);
+}
+
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+// ---------------------------------------------------------------------------------------------
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+	// make sure the viewport matches the new window dimensions; note that width and
+	// height will be significantly larger than specified on retina displays.
+	if (width > 0 && height > 0)
+	{
+		glViewport(0, 0, width, height);
+		WIDTH = width;
+		HEIGHT = height;
+	}
+}
@@ -0,0 +1,39 @@
+#version 330 core
+
+out vec4 fragColor;
+
+in vec3 normal;
+in vec2 texCoord;
+in vec3 fragPos;
+
+layout (std140) uniform FrameUniforms
+{
+	mat4 projection;
+	mat4 view;
+	vec4 cameraPos;
+	vec4 lightPos;
+	vec2 mousePos;
+	float time;
+};
+
+#ifdef TEXTURE_ARRAYS
+// the textures of the model are layers of texture arrays, see Mesh::setTextureLayers()
+uniform sampler2DArray texture_diffuse1;
+uniform int texture_diffuse1Layer;
+#else
+// the meshes of the model have no textures of their own, the app binds the streamed one to unit 0
+uniform sampler2D texture_diffuse1;
+#endif
+
+#include "lighting.glsl"
+
+void main()
+{
+	vec3 lighting = phongLighting(normalize(normal), fragPos, lightPos.xyz, cameraPos.xyz);
+#ifdef TEXTURE_ARRAYS
+	vec3 color = texture(texture_diffuse1, vec3(texCoord, texture_diffuse1Layer)).rgb;
+#else
+	vec3 color = texture(texture_diffuse1, texCoord).rgb;
+#endif
+	fragColor = vec4(color * lighting, 1.0);
+}
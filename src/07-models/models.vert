@@ -0,0 +1,45 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec2 texCoord;
+out vec3 normal;
+out vec3 fragPos;
+
+// shared by all programs, updated once per frame (binding 0), see FrameUniforms in util/shader.h
+layout (std140) uniform FrameUniforms
+{
+	mat4 projection;
+	mat4 view;
+	vec4 cameraPos;
+	vec4 lightPos;
+	vec2 mousePos;
+	float time;
+};
+
+#ifdef DRAW_UNIFORM_BLOCK
+// per draw call of the RenderQueue, taken from its ring (binding 1), see DrawUniforms in util/shader.h
+layout (std140) uniform DrawUniforms
+{
+	mat4 model;
+	mat4 normalMatrix;
+	vec4 positionScale; // maps quantized positions back to object space
+	vec4 positionOffset;
+};
+#else
+// direct draws: the matrices are set per instance, the position scale and offset per mesh (see Mesh::setPositionUniforms)
+uniform mat4 model;
+uniform mat4 normalMatrix;
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+#endif
+
+void main()
+{
+	vec4 position = vec4(aPos * positionScale.xyz + positionOffset.xyz, 1.0);
+	texCoord = aTexCoords;
+	normal = mat3(normalMatrix) * aNormal;
+	fragPos = vec3(model * position);
+	gl_Position = projection * view * model * position;
+}
@@ -0,0 +1,196 @@
+// Bakes images into block compressed KTX files with their full mip chain, so the loaders in util/assets.h and
+// util/model.h can upload them without decoding. Each image gets a <image>.ktx next to it, e.g.
+//
+//   tex-bake resources
+//   tex-bake --bc7 resources/images/brickwall.jpg
+//   tex-bake --flip resources/images   (for groups with { TEX_FLIP, true })
+//
+// Images are baked as BC1 (RGB), BC3 (RGBA) or BC4 (grey) unless a format is given; --bc7 uses BC7 for color images.
+// The mip levels of color images are averaged in linear light, those of data are averaged as they are. An image is data
+// if a part of its name is one of DATA_NAMES, e.g. brickwall_normal.jpg or rock-height.png; --linear treats every
+// image as data, --srgb every image as color. Files that are newer than their image are skipped unless --force is given.
+#include <glad/glad.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <util/ktx.h>
+#include <util/resample.h>
+#include <util/texcompress.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct Options
+{
+    bool flip = false;
+    bool force = false;
+    bool bc7 = false;
+    bool linear = false; // every image is data
+    bool srgb = false;   // every image is color
+    int format = -1; // a BlockFormat, or -1 to pick one by the number of channels
+};
+
+// the parts of a file name that mark an image as data rather than color, matched between '_', '-', '.' and ' '
+const char *DATA_NAMES[] = {"normal", "normals", "nrm", "norm", "height", "bump", "disp", "displacement", "rough", "roughness",
+                            "metal", "metallic", "metalness", "ao", "occlusion", "mask"};
+
+// true if the mip levels of the image are averaged in linear light
+bool isColor(const fs::path &image, const Options &options)
+{
+    if (options.linear || options.srgb)
+        return options.srgb;
+    std::string name = image.stem().string();
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    size_t start = 0;
+    while (start <= name.size())
+    {
+        size_t end = name.find_first_of("_-. ", start);
+        if (end == std::string::npos)
+            end = name.size();
+        std::string part = name.substr(start, end - start);
+        for (const char *data : DATA_NAMES)
+            if (part == data)
+                return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+BlockFormat pickFormat(int channels, const Options &options)
+{
+    if (options.format >= 0)
+        return (BlockFormat)options.format;
+    if (channels == 1)
+        return BlockFormat::BC4;
+    if (channels == 2)
+        return BlockFormat::BC5;
+    if (options.bc7)
+        return BlockFormat::BC7;
+    return channels == 3 ? BlockFormat::BC1 : BlockFormat::BC3;
+}
+
+// bakes one image; returns false if it couldn't be read or written. rawBytes and bakedBytes receive the video memory
+// the texture takes uncompressed (with mipmaps) and baked.
+// ------------------------------------------------------------------------
+bool bake(const fs::path &image, const Options &options, size_t &rawBytes, size_t &bakedBytes)
+{
+    fs::path output = image;
+    output += ".ktx";
+    if (!options.force && fs::exists(output) && fs::last_write_time(output) >= fs::last_write_time(image))
+        return true;
+
+    std::cout << "Baking " << image.string() << " ... ";
+    auto t1 = std::chrono::high_resolution_clock::now();
+    stbi_set_flip_vertically_on_load(options.flip);
+    int width, height, channels;
+    unsigned char *data = stbi_load(image.string().c_str(), &width, &height, &channels, 0);
+    if (!data)
+    {
+        std::cout << "ERROR::TEX_BAKE : " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    bool color = isColor(image, options);
+    std::vector<ImageResampler::Level> levels = ImageResampler::mipChain(data, width, height, channels, color, width, height);
+    stbi_image_free(data);
+
+    BlockFormat format = pickFormat(channels, options);
+    KtxTexture texture;
+    texture.internalFormat = BlockCompressor::glFormat(format);
+    texture.baseFormat = BlockCompressor::glBaseFormat(format);
+    texture.width = width;
+    texture.height = height;
+    texture.flipped = options.flip;
+    size_t raw = 0;
+    for (const ImageResampler::Level &level : levels)
+    {
+        std::vector<unsigned char> blocks = BlockCompressor::compress(level.pixels.data(), level.width, level.height, channels, format);
+        texture.levels.push_back({texture.data.size(), blocks.size()});
+        texture.data.insert(texture.data.end(), blocks.begin(), blocks.end());
+        raw += (size_t)level.width * level.height * (channels == 3 ? 4 : channels); // drivers pad RGB8 to four bytes
+    }
+    if (!WriteKtx(output.string(), texture))
+    {
+        std::cout << "ERROR::TEX_BAKE : could not write " << output.string() << std::endl;
+        return false;
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+    std::cout << "done (in " << (duration / 1000) << " milliseconds, " << BlockCompressor::name(format) << (color ? ", " : ", data, ")
+              << texture.levels.size() << " levels, " << (raw / 1024) << " KB -> " << (texture.data.size() / 1024) << " KB)." << std::endl;
+    rawBytes += raw;
+    bakedBytes += texture.data.size();
+    return true;
+}
+
+bool isImage(const fs::path &path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    for (const char *known : {".png", ".jpg", ".jpeg", ".tga", ".bmp", ".psd", ".gif"})
+        if (extension == known)
+            return true;
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    std::vector<fs::path> images;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--flip")
+            options.flip = true;
+        else if (argument == "--force")
+            options.force = true;
+        else if (argument == "--bc7")
+            options.bc7 = true;
+        else if (argument == "--linear")
+            options.linear = true;
+        else if (argument == "--srgb")
+            options.srgb = true;
+        else if (argument == "--format" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)std::toupper(c); });
+            for (int format = (int)BlockFormat::BC1; format <= (int)BlockFormat::BC7; format++)
+                if (name == BlockCompressor::name((BlockFormat)format))
+                    options.format = format;
+            if (options.format < 0)
+            {
+                std::cout << "ERROR::TEX_BAKE : unknown format " << name << std::endl;
+                return 1;
+            }
+        }
+        else if (fs::is_directory(argument))
+        {
+            for (const auto &entry : fs::recursive_directory_iterator(argument))
+                if (entry.is_regular_file() && isImage(entry.path()))
+                    images.push_back(entry.path());
+        }
+        else if (fs::is_regular_file(argument))
+            images.push_back(argument);
+        else
+        {
+            std::cout << "usage: tex-bake [--format bc1|bc3|bc4|bc5|bc7] [--bc7] [--linear|--srgb] [--flip] [--force] <image or directory>..." << std::endl;
+            return 1;
+        }
+    }
+
+    size_t rawBytes = 0, bakedBytes = 0;
+    int failed = 0;
+    for (const fs::path &image : images)
+        if (!bake(image, options, rawBytes, bakedBytes))
+            failed++;
+    if (rawBytes > 0)
+        std::cout << "Video memory of the baked textures: " << (rawBytes / 1024) << " KB uncompressed -> " << (bakedBytes / 1024) << " KB." << std::endl;
+    return failed > 0 ? 1 : 0;
+}